@@ -1,16 +1,27 @@
 #include <stdio.h>         // for printf()
 #include <pthread.h>       // for pthread_xxx() routines
 #include <time.h>
+#include <string.h>        // for strcmp()
+#include <signal.h>        // for checkpointing on SIGINT/SIGTERM
 #include "mcsim.h"
+#include "mcckpt.h"
 
 #include <limits.h>        //for modifying memory limits
 
+#define DEFAULT_CKPT_INTERVAL 10.0   // seconds between checkpoints
+
 
 double gcount;    // global counter -- a double to handle large sums (billions+)
 long numits;      // global variable for number of iterations (see step 3 below)
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_signal(int sig) {
+  interrupted = 1;
+}
+
 int main( int argc, char** argv ) {
 
   gcount = 0;
@@ -55,6 +66,19 @@ int main( int argc, char** argv ) {
       value of count = 23559
       time in seconds = 0.0761
 
+  ---------------------------------------------------------------------
+  Checkpointing (optional, after the two required arguments)
+  ---------------------------------------------------------------------
+
+    --checkpoint <file>   snapshot every thread's progress to <file>
+    --interval <secs>     seconds between snapshots (default 10)
+    --resume              continue the run saved in <file>
+
+  A snapshot is a few dozen bytes per thread, so even a 1 second
+  interval costs far less than 1% of throughput.  SIGINT or SIGTERM
+  writes a last snapshot before exiting.  A resumed run prints exactly
+  what an uninterrupted run would have.
+
   */
 
     //  1. Create the following variables:
@@ -68,6 +92,11 @@ int main( int argc, char** argv ) {
   error;        //    - error code for exit
   double time_elapsed;
 
+  char *ckpt_path = NULL;   // checkpoint file, if any
+  double ckpt_interval = DEFAULT_CKPT_INTERVAL, since_ckpt;
+  int resume = 0;
+  struct timespec tick = { 0, 100000000 }, last_ckpt, now, wake;
+
   // for the over-achievers
   pthread_attr_t attr;
   pthread_attr_init(&attr);
@@ -80,7 +109,28 @@ int main( int argc, char** argv ) {
   num_threads = atoi(argv[1]);
 
   //  3. Get number of iterations input by user from argv[2]
-  numits = atoi(argv[2]);
+  numits = atol(argv[2]);
+
+  //  optional checkpoint arguments
+  for (i = 3; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+      ckpt_path = argv[++i];
+    else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+      ckpt_interval = atof(argv[++i]);
+    else if (strcmp(argv[i], "--resume") == 0)
+      resume = 1;
+    else
+    {
+      fprintf(stderr, "unknown argument %s\n", argv[i]);
+      exit(1);
+    }
+  }
+  if (resume && ckpt_path == NULL)
+  {
+    fprintf(stderr, "--resume needs --checkpoint <file>\n");
+    exit(1);
+  }
 
   //  4. Get the maximum number of threads the OS can create (hint: getrlimit function)
   getrlimit(RLIMIT_NPROC, &max_threads);
@@ -94,6 +144,14 @@ int main( int argc, char** argv ) {
   //  6. Allocate an array of pthread structures using number of threads input by user (see step 2)
   threads = (pthread_t*) malloc(sizeof(pthread_t) * num_threads);
 
+  if (ckpt_path != NULL)
+  {
+    if (ckpt_init(ckpt_path, num_threads, numits, resume) != 0)
+      exit(1);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+  }
+
   //  7. Get start time of simulation and store in time struct
   clock_gettime(CLOCK_REALTIME, &start);
 
@@ -101,7 +159,7 @@ int main( int argc, char** argv ) {
   for (i = 0; i < num_threads; i++)
   {
 
-    if ((error = pthread_create(&(threads[i]), &attr, (void*) th_routine, (void*) thread_id++)) != 0)
+    if ((error = pthread_create(&(threads[i]), &attr, ckpt_path ? th_routine_ckpt : th_routine, (void*) (long) thread_id++)) != 0)
     {
       //if an error occurs during thread creation - exit simulation program immediately
       exit(error);
@@ -109,6 +167,39 @@ int main( int argc, char** argv ) {
 
   }
 
+  //  while checkpointing, wake up regularly to take snapshots; the last
+  //  thread to finish wakes us at once, so the timing is not rounded up
+  //  to a tick
+  if (ckpt_path != NULL)
+  {
+    last_ckpt = start;
+    while (1)
+    {
+      clock_gettime(CLOCK_REALTIME, &wake);
+      wake.tv_nsec += tick.tv_nsec;
+      if (wake.tv_nsec >= 1000000000)
+      {
+        wake.tv_sec++;
+        wake.tv_nsec -= 1000000000;
+      }
+      if (ckpt_wait(&wake) == num_threads)
+        break;
+      clock_gettime(CLOCK_REALTIME, &now);
+      since_ckpt = mydifftime(&last_ckpt, &now) / 1000000000;
+      if (interrupted || since_ckpt >= ckpt_interval)
+      {
+        if (ckpt_write(ckpt_path) != 0)
+          perror("checkpoint");
+        last_ckpt = now;
+      }
+      if (interrupted)
+      {
+        fprintf(stderr, "interrupted, resume with --checkpoint %s --resume\n", ckpt_path);
+        exit(1);
+      }
+    }
+  }
+
   //  9. Use a loop to join each pthread in created in the pthread array
   for (i = 0; i < num_threads; i++)
   {
@@ -124,6 +215,14 @@ int main( int argc, char** argv ) {
   //  store in time struct
   time_elapsed = mydifftime(&start, &end);
 
+  // the checkpointed threads keep their counts in their slots
+  if (ckpt_path != NULL)
+  {
+    if (ckpt_write(ckpt_path) != 0)
+      perror("checkpoint");
+    gcount = ckpt_total();
+  }
+
   //print data
   printf("monte carlo value of PI: %.6f\nvalue of count: %.0f\ntime in seconds: %.4f\n\n", (4 * gcount/(numits * num_threads)), gcount, time_elapsed / 1000000000);
 
@@ -0,0 +1,62 @@
+#include "mcblock.h"
+
+// drand48 is the 48 bit LCG x' = (a*x + c) mod 2^48
+#define LCG_A    0x5DEECE66DULL
+#define LCG_C    0xBULL
+#define LCG_MASK 0xFFFFFFFFFFFFULL
+
+// position buf at iteration iter of the stream for seed; each iteration
+// draws two numbers, so this jumps 2*iter steps in O(log iter)
+void mc_seek(struct drand48_data *buf, long seed, long iter)
+{
+  unsigned long long x = (((unsigned long long) seed & 0xFFFFFFFFULL) << 16) | 0x330E;
+  unsigned long long a = LCG_A, c = LCG_C;   // one step
+  unsigned long long ja = 1, jc = 0;         // the jump built so far
+  unsigned long long k = 2 * (unsigned long long) iter;
+  unsigned short xsubi[3];
+
+  while (k) {
+    if (k & 1) {
+      ja = (ja * a) & LCG_MASK;
+      jc = (jc * a + c) & LCG_MASK;
+    }
+    c = (c * (a + 1)) & LCG_MASK;   // two steps of (a, c) composed
+    a = (a * a) & LCG_MASK;
+    k >>= 1;
+  }
+  x = (ja * x + jc) & LCG_MASK;
+
+  xsubi[0] = (unsigned short) x;
+  xsubi[1] = (unsigned short) (x >> 16);
+  xsubi[2] = (unsigned short) (x >> 32);
+  seed48_r(xsubi, buf);   // also resets a and c to the drand48 defaults
+
+} // end mc_seek function
+
+// same loop as th_routine, on a caller supplied state
+long mc_sample(struct drand48_data *buf, long count)
+{
+  double x, y;
+  long i;
+  long hits = 0;
+
+  for (i = 0; i < count; i++) {
+    drand48_r(buf, &x);
+    drand48_r(buf, &y);
+
+    if (x*x + y*y <= 1)
+      hits++;
+  }
+
+  return hits;
+
+} // end mc_sample function
+
+long mc_block_run(const struct mc_block *b)
+{
+  struct drand48_data buf;
+
+  mc_seek(&buf, b->seed, b->start);
+  return mc_sample(&buf, b->count);
+
+} // end mc_block_run function
@@ -0,0 +1,19 @@
+#include <stdlib.h>        // for drand48_r(), seed48_r()
+
+// a block of work: iterations [start, start + count) of the drand48
+// stream th_routine would use for thread id "seed"
+struct mc_block {
+  long seed;
+  long start;
+  long count;
+};
+
+// position buf at iteration iter of the stream seeded with seed, exactly
+// as if srand48_r(seed) had been followed by iter iterations of th_routine
+void mc_seek(struct drand48_data *buf, long seed, long iter);
+
+// run count iterations of th_routine's loop on buf and return the hits
+long mc_sample(struct drand48_data *buf, long count);
+
+// run a whole block and return the number of hits
+long mc_block_run(const struct mc_block *b);
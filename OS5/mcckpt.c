@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>        // for fsync()
+#include <pthread.h>
+#include "mcckpt.h"
+
+#define CKPT_MAGIC   0x4B43434DUL   // "MCCK"
+#define CKPT_VERSION 1
+
+// snapshot file: this header followed by one mc_slot per thread
+struct ckpt_header {
+  unsigned long magic;
+  long version;
+  long num_threads;
+  long numits;
+};
+
+static struct mc_slot *slots;
+static long ckpt_threads;
+static long ckpt_its;
+static int finished;
+
+static pthread_mutex_t ckpt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ckpt_done = PTHREAD_COND_INITIALIZER;   // a thread finished
+
+int ckpt_init(const char *path, int num_threads, long numits, int resume)
+{
+  struct ckpt_header h;
+  FILE *fp;
+
+  ckpt_threads = num_threads;
+  ckpt_its = numits;
+  finished = 0;
+  slots = calloc(num_threads, sizeof(struct mc_slot));
+
+  if (!resume)
+    return 0;
+
+  if ((fp = fopen(path, "rb")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  if (fread(&h, sizeof(h), 1, fp) != 1 || h.magic != CKPT_MAGIC || h.version != CKPT_VERSION
+      || h.num_threads != num_threads || h.numits != numits
+      || fread(slots, sizeof(struct mc_slot), num_threads, fp) != num_threads) {
+    fprintf(stderr, "%s is not a checkpoint of a %d thread, %ld iteration run\n",
+            path, num_threads, numits);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  return 0;
+
+} // end ckpt_init function
+
+void* th_routine_ckpt(void* th_args)
+{
+  long tid = (long) th_args;
+  struct drand48_data buf;
+  long done = slots[tid].done;     // only this thread writes its slot
+  long count = slots[tid].count;
+  long n;
+
+  // put the generator where the snapshot left off (or at the start)
+  mc_seek(&buf, tid, done);
+
+  while (done < ckpt_its) {
+    n = ckpt_its - done < CKPT_CHUNK ? ckpt_its - done : CKPT_CHUNK;
+    count += mc_sample(&buf, n);
+    done += n;
+
+    pthread_mutex_lock(&ckpt_mutex);
+    slots[tid].done = done;
+    slots[tid].count = count;
+    pthread_mutex_unlock(&ckpt_mutex);
+  }
+
+  // counted here, not in the loop, so a thread with nothing left to do
+  // (no iterations, or already done in the snapshot) counts as well
+  pthread_mutex_lock(&ckpt_mutex);
+  finished++;
+  pthread_cond_signal(&ckpt_done);
+  pthread_mutex_unlock(&ckpt_mutex);
+
+  return 0;
+
+} // end th_routine_ckpt function
+
+int ckpt_write(const char *path)
+{
+  struct ckpt_header h;
+  char tmp[4096];
+  FILE *fp;
+  int ok;
+
+  h.magic = CKPT_MAGIC;
+  h.version = CKPT_VERSION;
+  h.num_threads = ckpt_threads;
+  h.numits = ckpt_its;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if ((fp = fopen(tmp, "wb")) == NULL)
+    return -1;
+
+  // write the new snapshot beside the old one, then rename over it, so a
+  // crash at any point leaves one complete snapshot on disk
+  pthread_mutex_lock(&ckpt_mutex);
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1
+       && fwrite(slots, sizeof(struct mc_slot), ckpt_threads, fp) == ckpt_threads;
+  pthread_mutex_unlock(&ckpt_mutex);
+
+  ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fclose(fp) != 0 || !ok || rename(tmp, path) != 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+
+} // end ckpt_write function
+
+int ckpt_wait(const struct timespec *deadline)
+{
+  int n;
+
+  pthread_mutex_lock(&ckpt_mutex);
+  while (finished < ckpt_threads)
+    if (pthread_cond_timedwait(&ckpt_done, &ckpt_mutex, deadline) != 0)
+      break;
+  n = finished;
+  pthread_mutex_unlock(&ckpt_mutex);
+  return n;
+
+} // end ckpt_wait function
+
+double ckpt_total(void)
+{
+  double total = 0;
+  long i;
+
+  pthread_mutex_lock(&ckpt_mutex);
+  for (i = 0; i < ckpt_threads; i++)
+    total += slots[i].count;
+  pthread_mutex_unlock(&ckpt_mutex);
+  return total;
+
+} // end ckpt_total function
@@ -0,0 +1,33 @@
+#include <time.h>
+#include "mcblock.h"
+
+// iterations a thread runs between publishing its progress
+#define CKPT_CHUNK (1L << 20)
+
+// what a snapshot holds for each thread.  The drand48 state after "done"
+// iterations is fully determined by the thread id and done (see mc_seek),
+// so those two numbers are the whole PRNG state.
+struct mc_slot {
+  long done;      // iterations finished
+  long count;     // hits among them
+};
+
+// set up slots for num_threads threads of numits iterations; if resume is
+// set, load them from path instead.  Returns 0, or -1 if the snapshot is
+// missing or belongs to a different run.
+int ckpt_init(const char *path, int num_threads, long numits, int resume);
+
+// th_routine that publishes its progress every CKPT_CHUNK iterations and
+// continues from its slot when resuming
+void* th_routine_ckpt(void* th_args);
+
+// atomically replace path with a snapshot of every thread's progress
+int ckpt_write(const char *path);
+
+// sleep until every thread has finished or until the absolute
+// CLOCK_REALTIME time deadline, whichever comes first; returns the
+// number of threads that have finished
+int ckpt_wait(const struct timespec *deadline);
+
+// sum of the hit counts in every thread's slot
+double ckpt_total(void);
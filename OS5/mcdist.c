@@ -0,0 +1,403 @@
+#include <stdio.h>         // for printf()
+#include <string.h>
+#include <signal.h>        // for ignoring SIGPIPE from dead workers
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "mcblock.h"
+#include "mcnet.h"
+
+/*
+
+  ---------------------------------------------------------------------
+  Distributed Monte carlo simulator to estimate PI
+  ---------------------------------------------------------------------
+  The same work as "./hw5 <threads> <iterations>" -- one drand48 stream
+  per thread id, each run for <iterations> -- cut into blocks that are
+  handed out to worker processes over a socket.  Every block is
+  positioned exactly on its stream (see mc_seek), so the count does not
+  depend on how many workers there are or which one ran what.
+
+    ./mcdist coord <addr> <threads> <iterations> [block]
+    ./mcdist work <addr> [connections]
+    ./mcdist local <threads> <iterations> [block]
+
+  <addr> is a Unix socket path if it contains a '/', otherwise host:port.
+  A worker opens [connections] connections (default 1), each served by
+  its own thread.  If a worker goes away, the blocks it was running are
+  handed to someone else.  "local" runs the same blocks on threads in
+  this process, for comparison.
+
+  Protocol, one line per message:
+    coordinator -> worker   B <index> <seed> <start> <count>
+                            Q
+    worker -> coordinator   R <index> <hits>
+
+*/
+
+#define DEFAULT_BLOCK  1000000   // iterations per block
+#define MAX_WORKERS    256       // connections the coordinator serves
+#define INFLIGHT       2         // blocks queued on each connection
+
+enum block_state { PENDING, ASSIGNED, DONE };
+
+static struct mc_block *blocks;
+static enum block_state *state;
+static int *owner;               // connection slot running each block
+static long nblocks;
+static double total;             // sum of hits -- a double like gcount
+
+// ---------------------------------------------------------------------
+// work list shared by the coordinator and local mode
+// ---------------------------------------------------------------------
+
+static long next_block;          // first block never handed out
+static long *requeued;           // blocks taken back from dead workers
+static long nrequeued;
+
+static void make_blocks(long threads, long its, long blocksize)
+{
+  long per_seed = (its + blocksize - 1) / blocksize;
+  long s, j, b = 0;
+
+  nblocks = threads * per_seed;
+  blocks = malloc(sizeof(struct mc_block) * (nblocks ? nblocks : 1));
+  state = calloc(nblocks ? nblocks : 1, sizeof(enum block_state));
+  owner = malloc(sizeof(int) * (nblocks ? nblocks : 1));
+  requeued = malloc(sizeof(long) * (nblocks ? nblocks : 1));
+
+  for (s = 0; s < threads; s++) {
+    for (j = 0; j < per_seed; j++) {
+      blocks[b].seed = s;
+      blocks[b].start = j * blocksize;
+      blocks[b].count = (j + 1) * blocksize > its ? its - j * blocksize : blocksize;
+      b++;
+    }
+  }
+  next_block = 0;
+  nrequeued = 0;
+
+} // end make_blocks function
+
+// next block to hand out, or -1 if everything is out or done
+static long take_block(void)
+{
+  if (nrequeued > 0)
+    return requeued[--nrequeued];
+  if (next_block < nblocks)
+    return next_block++;
+  return -1;
+
+} // end take_block function
+
+// ---------------------------------------------------------------------
+// coordinator
+// ---------------------------------------------------------------------
+
+struct conn {
+  int fd;
+  int inflight;
+  char buf[LINE_LEN * 4];
+  size_t len;
+};
+
+static struct conn conns[MAX_WORKERS];
+
+// keep INFLIGHT blocks queued on connection c
+static int feed(int c)
+{
+  char line[LINE_LEN];
+  long b;
+  int n;
+
+  while (conns[c].inflight < INFLIGHT && (b = take_block()) >= 0) {
+    n = snprintf(line, sizeof(line), "B %ld %ld %ld %ld\n",
+                 b, blocks[b].seed, blocks[b].start, blocks[b].count);
+    state[b] = ASSIGNED;
+    owner[b] = c;
+    conns[c].inflight++;
+    if (write_all(conns[c].fd, line, n) != 0)
+      return -1;
+  }
+  return 0;
+
+} // end feed function
+
+// worker c is gone: give its unfinished blocks to someone else
+static void drop(int c)
+{
+  long b, lost = 0;
+
+  for (b = 0; b < nblocks; b++) {
+    if (state[b] == ASSIGNED && owner[b] == c) {
+      state[b] = PENDING;
+      requeued[nrequeued++] = b;
+      lost++;
+    }
+  }
+  if (lost > 0)
+    fprintf(stderr, "worker %d lost, requeueing %ld block(s)\n", c, lost);
+
+  close(conns[c].fd);
+  conns[c].fd = -1;
+  conns[c].inflight = 0;
+  conns[c].len = 0;
+
+} // end drop function
+
+// handle the complete result lines buffered on connection c
+static long collect(int c)
+{
+  char *line = conns[c].buf, *nl;
+  long b, hits, done = 0;
+
+  while ((nl = memchr(line, '\n', conns[c].buf + conns[c].len - line)) != NULL) {
+    *nl = '\0';
+    if (sscanf(line, "R %ld %ld", &b, &hits) == 2 && b >= 0 && b < nblocks
+        && state[b] == ASSIGNED && owner[b] == c) {
+      state[b] = DONE;
+      total += hits;
+      conns[c].inflight--;
+      done++;
+    }
+    line = nl + 1;
+  }
+  conns[c].len -= line - conns[c].buf;
+  memmove(conns[c].buf, line, conns[c].len);
+  return done;
+
+} // end collect function
+
+static void coordinator(const char *addr)
+{
+  struct pollfd fds[MAX_WORKERS + 1];
+  int slot[MAX_WORKERS + 1];
+  int lfd, nfds, i, c, fd;
+  long done = 0;
+  ssize_t n;
+
+  if ((lfd = open_socket(addr, 1)) < 0) {
+    perror("coordinator: cannot listen");
+    exit(1);
+  }
+  for (c = 0; c < MAX_WORKERS; c++)
+    conns[c].fd = -1;
+
+  while (done < nblocks) {
+    fds[0].fd = lfd;
+    fds[0].events = POLLIN;
+    nfds = 1;
+    for (c = 0; c < MAX_WORKERS; c++) {
+      if (conns[c].fd >= 0) {
+        fds[nfds].fd = conns[c].fd;
+        fds[nfds].events = POLLIN;
+        slot[nfds++] = c;
+      }
+    }
+
+    if (poll(fds, nfds, -1) < 0) {
+      perror("coordinator: poll");
+      exit(1);
+    }
+
+    for (i = 1; i < nfds; i++) {
+      c = slot[i];
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      n = read(conns[c].fd, conns[c].buf + conns[c].len, sizeof(conns[c].buf) - conns[c].len);
+      if (n <= 0) {
+        drop(c);
+        continue;
+      }
+      conns[c].len += n;
+      done += collect(c);
+      if (conns[c].len == sizeof(conns[c].buf) || feed(c) != 0)
+        drop(c);
+    }
+
+    // blocks requeued from a dead worker go to whoever is idle
+    for (c = 0; c < MAX_WORKERS && nrequeued > 0; c++)
+      if (conns[c].fd >= 0 && feed(c) != 0)
+        drop(c);
+
+    if (fds[0].revents & POLLIN) {
+      if ((fd = accept(lfd, NULL, NULL)) < 0)
+        continue;
+      for (c = 0; c < MAX_WORKERS && conns[c].fd >= 0; c++)
+        ;
+      if (c == MAX_WORKERS) {
+        close(fd);
+        continue;
+      }
+      conns[c].fd = fd;
+      conns[c].inflight = 0;
+      conns[c].len = 0;
+      if (feed(c) != 0)
+        drop(c);
+    }
+  }
+
+  for (c = 0; c < MAX_WORKERS; c++) {
+    if (conns[c].fd >= 0) {
+      write_all(conns[c].fd, "Q\n", 2);
+      close(conns[c].fd);
+    }
+  }
+  close(lfd);
+  if (strchr(addr, '/') != NULL)
+    unlink(addr);
+
+} // end coordinator function
+
+// ---------------------------------------------------------------------
+// worker
+// ---------------------------------------------------------------------
+
+// serve one connection until the coordinator says Q or goes away
+static void* th_worker(void* th_args)
+{
+  const char *addr = (const char*) th_args;
+  struct mc_block b;
+  char line[LINE_LEN];
+  long index;
+  int fd, n;
+  FILE *in;
+
+  if ((fd = open_socket(addr, 0)) < 0) {
+    perror("worker: cannot connect");
+    return (void*) 1;
+  }
+  in = fdopen(dup(fd), "r");
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (line[0] == 'Q')
+      break;
+    if (sscanf(line, "B %ld %ld %ld %ld", &index, &b.seed, &b.start, &b.count) != 4)
+      continue;
+    n = snprintf(line, sizeof(line), "R %ld %ld\n", index, mc_block_run(&b));
+    if (write_all(fd, line, n) != 0)
+      break;
+  }
+
+  fclose(in);
+  close(fd);
+  return 0;
+
+} // end th_worker function
+
+// ---------------------------------------------------------------------
+// local mode
+// ---------------------------------------------------------------------
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* th_local(void* th_args)
+{
+  long b, hits;
+
+  while (1) {
+    pthread_mutex_lock(&mutex);
+    b = take_block();
+    pthread_mutex_unlock(&mutex);
+    if (b < 0)
+      break;
+
+    hits = mc_block_run(&blocks[b]);
+
+    pthread_mutex_lock(&mutex);
+    total += hits;
+    pthread_mutex_unlock(&mutex);
+  }
+  return 0;
+
+} // end th_local function
+
+// ---------------------------------------------------------------------
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: mcdist coord <addr> <threads> <iterations> [block]\n"
+                  "       mcdist work <addr> [connections]\n"
+                  "       mcdist local <threads> <iterations> [block]\n");
+  exit(1);
+
+} // end usage function
+
+int main( int argc, char** argv ) {
+
+  pthread_t *threads;
+  struct timespec start, end;
+  long num_threads, its, blocksize = DEFAULT_BLOCK, i;
+  double secs;
+  int error;
+
+  if (argc < 3)
+    usage();
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if (strcmp(argv[1], "work") == 0) {
+    num_threads = argc > 3 ? atol(argv[3]) : 1;
+    if (num_threads < 1)
+      usage();
+    threads = (pthread_t*) malloc(sizeof(pthread_t) * num_threads);
+    for (i = 0; i < num_threads; i++)
+      if ((error = pthread_create(&threads[i], NULL, th_worker, argv[2])) != 0)
+        exit(error);
+    for (i = 0; i < num_threads; i++)
+      if ((error = pthread_join(threads[i], NULL)) != 0)
+        exit(error);
+    free(threads);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "coord") == 0 && argc >= 5) {
+    num_threads = atol(argv[3]);
+    its = atol(argv[4]);
+    if (argc > 5)
+      blocksize = atol(argv[5]);
+  }
+  else if (strcmp(argv[1], "local") == 0 && argc >= 4) {
+    num_threads = atol(argv[2]);
+    its = atol(argv[3]);
+    if (argc > 4)
+      blocksize = atol(argv[4]);
+  }
+  else
+    usage();
+
+  if (num_threads < 1 || its < 1 || blocksize < 1)
+    usage();
+
+  make_blocks(num_threads, its, blocksize);
+  clock_gettime(CLOCK_REALTIME, &start);
+
+  if (argv[1][0] == 'c') {
+    coordinator(argv[2]);
+  }
+  else {
+    threads = (pthread_t*) malloc(sizeof(pthread_t) * num_threads);
+    for (i = 0; i < num_threads; i++)
+      if ((error = pthread_create(&threads[i], NULL, th_local, NULL)) != 0)
+        exit(error);
+    for (i = 0; i < num_threads; i++)
+      if ((error = pthread_join(threads[i], NULL)) != 0)
+        exit(error);
+    free(threads);
+  }
+
+  clock_gettime(CLOCK_REALTIME, &end);
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("monte carlo value of PI: %.6f\nvalue of count: %.0f\ntime in seconds: %.4f\n\n",
+         4 * total / ((double) its * num_threads), total, secs);
+
+  free(blocks);
+  free(state);
+  free(owner);
+  free(requeued);
+  return 0;
+
+} // end main function
@@ -0,0 +1,154 @@
+#include <stdio.h>         // for printf()
+#include <stdlib.h>        // for qsort()
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "mcnet.h"
+
+/*
+
+  ---------------------------------------------------------------------
+  Load generator for mcserv
+  ---------------------------------------------------------------------
+
+    ./mcload <addr> <clients> <jobs> <iterations> [precision]
+
+  Starts <clients> threads, each with its own connection, and has each
+  send <jobs> jobs one after the other (the next job goes out when the
+  previous answer is back).  Every job uses a different seed.  Prints
+  the round trip latency percentiles seen by the clients, the mean of
+  the latencies the server reported, the job rate, and the server's
+  own counters.
+
+*/
+
+static const char *addr;
+static long num_jobs, its;
+static double precision;
+static double *rtt;        // round trip per job, microseconds
+static double *served;     // latency the server reported, microseconds
+static long failed;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double usec_between(struct timespec *t0, struct timespec *t1)
+{
+  return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+
+} // end usec_between function
+
+static void* th_client(void* th_args)
+{
+  long client = (long) th_args, k, id, hits, n, bad = 0;
+  struct timespec t0, t1;
+  char line[LINE_LEN];
+  double pi, lat;
+  FILE *in;
+  int fd, len;
+
+  if ((fd = open_socket(addr, 0)) < 0) {
+    perror("mcload: cannot connect");
+    exit(1);
+  }
+  in = fdopen(dup(fd), "r");
+
+  for (k = 0; k < num_jobs; k++) {
+    id = client * num_jobs + k;
+    len = snprintf(line, sizeof(line), "J %ld %ld %ld %g\n", id, its, id, precision);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (write_all(fd, line, len) != 0 || fgets(line, sizeof(line), in) == NULL) {
+      fprintf(stderr, "mcload: server went away\n");
+      exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (sscanf(line, "R %ld %lf %ld %ld %lf", &id, &pi, &hits, &n, &lat) != 5) {
+      bad++;
+      lat = 0;
+    }
+    rtt[client * num_jobs + k] = usec_between(&t0, &t1);
+    served[client * num_jobs + k] = lat;
+  }
+
+  pthread_mutex_lock(&mutex);
+  failed += bad;
+  pthread_mutex_unlock(&mutex);
+
+  fclose(in);
+  close(fd);
+  return 0;
+
+} // end th_client function
+
+static int by_value(const void *a, const void *b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+  return x < y ? -1 : x > y;
+
+} // end by_value function
+
+int main( int argc, char** argv ) {
+
+  pthread_t *threads;
+  struct timespec start, end;
+  long num_clients, total, i;
+  double secs, mean_served = 0;
+  char line[LINE_LEN * 2];
+  FILE *in;
+  int fd, error;
+
+  if (argc < 5) {
+    fprintf(stderr, "usage: mcload <addr> <clients> <jobs> <iterations> [precision]\n");
+    exit(1);
+  }
+  addr = argv[1];
+  num_clients = atol(argv[2]);
+  num_jobs = atol(argv[3]);
+  its = atol(argv[4]);
+  precision = argc > 5 ? atof(argv[5]) : 0;
+  if (num_clients < 1 || num_jobs < 1 || its < 1) {
+    fprintf(stderr, "clients, jobs and iterations must be positive\n");
+    exit(1);
+  }
+
+  total = num_clients * num_jobs;
+  rtt = malloc(sizeof(double) * total);
+  served = malloc(sizeof(double) * total);
+  threads = (pthread_t*) malloc(sizeof(pthread_t) * num_clients);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_clients; i++)
+    if ((error = pthread_create(&threads[i], NULL, th_client, (void*) i)) != 0)
+      exit(error);
+  for (i = 0; i < num_clients; i++)
+    if ((error = pthread_join(threads[i], NULL)) != 0)
+      exit(error);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  secs = usec_between(&start, &end) / 1e6;
+
+  for (i = 0; i < total; i++)
+    mean_served += served[i] / total;
+  qsort(rtt, total, sizeof(double), by_value);
+
+  printf("jobs: %ld (%ld failed)\njobs per second: %.1f\n", total, failed, total / secs);
+  printf("round trip usec: p50 %.0f  p99 %.0f  max %.0f\n",
+         rtt[total / 2], rtt[(long) (total * 0.99)], rtt[total - 1]);
+  printf("server latency usec: mean %.0f\n", mean_served);
+
+  // and what the server counted
+  if ((fd = open_socket(addr, 0)) >= 0) {
+    in = fdopen(fd, "r+");
+    fputs("S\n", in);
+    fflush(in);
+    if (fgets(line, sizeof(line), in) != NULL)
+      printf("server: %s", line + 2);
+    fclose(in);
+  }
+
+  free(rtt);
+  free(served);
+  free(threads);
+  return 0;
+
+} // end main function
@@ -0,0 +1,79 @@
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>         // for getaddrinfo()
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mcnet.h"
+
+// open a socket for addr; listening if serve is set, else connected
+int open_socket(const char *addr, int serve)
+{
+  struct sockaddr_un un;
+  struct addrinfo hints, *res, *ai;
+  char host[LINE_LEN], *port;
+  int fd = -1, one = 1;
+
+  if (strchr(addr, '/') != NULL) {
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, addr, sizeof(un.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+    if (serve) {
+      unlink(addr);
+      if (bind(fd, (struct sockaddr*) &un, sizeof(un)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+      }
+    }
+    else if (connect(fd, (struct sockaddr*) &un, sizeof(un)) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  strncpy(host, addr, sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+  if ((port = strrchr(host, ':')) == NULL)
+    return -1;
+  *port++ = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = serve ? AI_PASSIVE : 0;
+  if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0)
+    return -1;
+
+  for (ai = res; ai != NULL; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+    if (serve) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+        break;
+    }
+    else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+
+} // end open_socket function
+
+int write_all(int fd, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = write(fd, buf, len)) <= 0)
+      return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+
+} // end write_all function
@@ -0,0 +1,11 @@
+#include <stddef.h>        // for size_t
+
+#define LINE_LEN 128       // longest protocol line
+
+// open a stream socket for addr -- a Unix socket path if it contains a
+// '/', otherwise host:port.  Listening if serve is set, else connected.
+// Returns the descriptor, or -1 with errno set.
+int open_socket(const char *addr, int serve);
+
+// write all of buf, returning -1 if the peer has gone
+int write_all(int fd, const char *buf, size_t len);
@@ -0,0 +1,402 @@
+#include <stdio.h>         // for printf()
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <math.h>          // for ceil()
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "mcblock.h"
+#include "mcnet.h"
+
+/*
+
+  ---------------------------------------------------------------------
+  Resident Monte carlo job server
+  ---------------------------------------------------------------------
+  Keeps a pool of worker threads running th_routine's sampling loop and
+  answers estimation jobs sent over a socket, so a caller does not pay
+  for process start-up and thread creation on every estimate.
+
+    ./mcserv <addr> [workers]
+
+  <addr> is a Unix socket path (or host:port), [workers] defaults to
+  the number of online CPUs.  Jobs wait on one shared run queue and are
+  served round robin: a worker cuts the next SERVE_BLOCK iteration task
+  off the job at the head and moves the job to the back if it has more
+  left.  So concurrent jobs are spread over the whole pool and a big job
+  cannot hold up the small ones that arrive after it.  A worker takes up
+  to SERVE_BATCH iterations of tasks per visit to the queue, so small
+  jobs are batched together.
+
+  Protocol, one line per message:
+    client -> server   J <id> <iterations> <seed> <precision>
+                       S
+    server -> client   R <id> <pi> <hits> <iterations> <latency in usec>
+                       E <id> <reason>
+                       S <counters>
+
+  A job samples the drand48 stream for <seed>, the one th_routine uses
+  for thread id <seed>, so its answer does not depend on how it was
+  split.  If <precision> is positive the iteration count is capped,
+  before the job starts, at the number the theoretical variance of the
+  estimate (at p = pi/4) says is enough for that standard error.
+  The latency is from the request arriving to the answer being ready.
+
+*/
+
+#define MAX_CLIENTS  256
+#define SERVE_BLOCK  (1L << 18)    // iterations per task
+#define SERVE_BATCH  (1L << 18)    // iterations a worker takes at once
+#define MAX_BATCH    64            // tasks a worker takes at once
+
+// variance of 4 * (hit or miss): 16 p (1 - p) with p = pi/4, so a job
+// needs PI_VARIANCE / precision^2 iterations for that standard error
+#define PI_VARIANCE  2.6967619
+
+struct job {
+  long id;              // the client's id, echoed back
+  int client;           // connection slot of the client ...
+  unsigned long gen;    // ... and its generation, in case it went away
+  long seed;
+  long its;
+  double hits;
+  long next;            // first iteration not yet handed to a worker
+  long pending;         // tasks not yet run
+  struct job *queued;   // next job in the run queue
+  struct timespec arrived;
+};
+
+// one SERVE_BLOCK (or shorter) piece of a job, cut off when a worker takes it
+struct task {
+  struct job *job;
+  struct mc_block b;
+};
+
+struct conn {
+  int fd;
+  unsigned long gen;
+  char buf[LINE_LEN * 4];
+  size_t len;
+};
+
+// shared with the workers, under qmutex: jobs with work left to hand out
+static struct job *head, *tail;
+static long queued_tasks;
+static double samples_done;
+static pthread_mutex_t qmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qcond = PTHREAD_COND_INITIALIZER;
+
+// finished jobs come back to the main thread through this pipe
+static int done_pipe[2];
+
+// main thread only
+static struct conn conns[MAX_CLIENTS];
+static long active_jobs;
+static unsigned long jobs_done;
+static struct timespec started;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig) {
+  stopping = 1;
+}
+
+static double seconds_since(const struct timespec *t0)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - t0->tv_sec) + (now.tv_nsec - t0->tv_nsec) / 1e9;
+
+} // end seconds_since function
+
+// ---------------------------------------------------------------------
+// worker pool
+// ---------------------------------------------------------------------
+
+static void* th_serve(void* th_args)
+{
+  struct task batch[MAX_BATCH];
+  long hits[MAX_BATCH];
+  struct job *finished[MAX_BATCH], *j;
+  long its;
+  int n, nfinished, i;
+
+  while (1) {
+    pthread_mutex_lock(&qmutex);
+    while (head == NULL)
+      pthread_cond_wait(&qcond, &qmutex);
+    // round robin: one task from the job at the head, which then goes to
+    // the back if it has more, so a big job cannot hold up small ones
+    for (n = 0, its = 0; head != NULL && n < MAX_BATCH && its < SERVE_BATCH; n++) {
+      j = head;
+      batch[n].job = j;
+      batch[n].b.seed = j->seed;
+      batch[n].b.start = j->next;
+      batch[n].b.count = j->its - j->next < SERVE_BLOCK ? j->its - j->next : SERVE_BLOCK;
+      j->next += batch[n].b.count;
+      its += batch[n].b.count;
+      head = j->queued;
+      j->queued = NULL;
+      if (head == NULL)
+        tail = NULL;
+      if (j->next < j->its) {
+        if (tail)
+          tail->queued = j;
+        else
+          head = j;
+        tail = j;
+      }
+    }
+    queued_tasks -= n;
+    pthread_mutex_unlock(&qmutex);
+
+    for (i = 0; i < n; i++)
+      hits[i] = mc_block_run(&batch[i].b);
+
+    nfinished = 0;
+    pthread_mutex_lock(&qmutex);
+    for (i = 0; i < n; i++) {
+      batch[i].job->hits += hits[i];
+      samples_done += batch[i].b.count;
+      if (--batch[i].job->pending == 0)
+        finished[nfinished++] = batch[i].job;
+    }
+    pthread_mutex_unlock(&qmutex);
+
+    for (i = 0; i < nfinished; i++)
+      if (write(done_pipe[1], &finished[i], sizeof(struct job*)) != sizeof(struct job*))
+        perror("mcserv: done pipe");
+  }
+  return 0;
+
+} // end th_serve function
+
+// put a job on the run queue; its tasks are cut off one at a time as
+// workers reach it
+static void submit(struct job *j)
+{
+  j->next = 0;
+  j->pending = (j->its + SERVE_BLOCK - 1) / SERVE_BLOCK;
+  j->queued = NULL;
+
+  pthread_mutex_lock(&qmutex);
+  if (tail)
+    tail->queued = j;
+  else
+    head = j;
+  tail = j;
+  queued_tasks += j->pending;
+  pthread_cond_broadcast(&qcond);
+  pthread_mutex_unlock(&qmutex);
+
+} // end submit function
+
+// ---------------------------------------------------------------------
+// clients
+// ---------------------------------------------------------------------
+
+static void reply(int c, const char *line, int n)
+{
+  if (conns[c].fd >= 0 && write_all(conns[c].fd, line, n) != 0) {
+    close(conns[c].fd);
+    conns[c].fd = -1;
+    conns[c].gen++;
+  }
+
+} // end reply function
+
+static void stats(int c)
+{
+  char line[LINE_LEN * 2];
+  double up = seconds_since(&started), samples;
+  long tasks;
+  int n;
+
+  pthread_mutex_lock(&qmutex);
+  tasks = queued_tasks;
+  samples = samples_done;
+  pthread_mutex_unlock(&qmutex);
+
+  n = snprintf(line, sizeof(line),
+               "S queue %ld jobs %ld done %lu uptime %.3f jobs_per_sec %.1f samples_per_sec %.0f\n",
+               tasks, active_jobs, jobs_done, up, jobs_done / up, samples / up);
+  reply(c, line, n);
+
+} // end stats function
+
+// handle the complete request lines buffered on connection c
+static void requests(int c)
+{
+  char *line = conns[c].buf, *nl, out[LINE_LEN];
+  struct job *j;
+  long id, its, seed;
+  double precision, need;
+  int n;
+
+  while (conns[c].fd >= 0
+         && (nl = memchr(line, '\n', conns[c].buf + conns[c].len - line)) != NULL) {
+    *nl = '\0';
+    if (line[0] == 'S') {
+      stats(c);
+    }
+    else if (sscanf(line, "J %ld %ld %ld %lf", &id, &its, &seed, &precision) == 4) {
+      if (precision > 0) {
+        // compared as a double: for tiny precisions need is beyond a long
+        need = ceil(PI_VARIANCE / (precision * precision));
+        if (need < its)
+          its = (long) need;
+      }
+      if (its < 1 || seed < 0) {
+        n = snprintf(out, sizeof(out), "E %ld bad job\n", id);
+        reply(c, out, n);
+      }
+      else {
+        j = malloc(sizeof(struct job));
+        j->id = id;
+        j->client = c;
+        j->gen = conns[c].gen;
+        j->seed = seed;
+        j->its = its;
+        j->hits = 0;
+        clock_gettime(CLOCK_MONOTONIC, &j->arrived);
+        active_jobs++;
+        submit(j);
+      }
+    }
+    line = nl + 1;
+  }
+  if (conns[c].fd < 0)
+    return;
+  conns[c].len -= line - conns[c].buf;
+  memmove(conns[c].buf, line, conns[c].len);
+
+} // end requests function
+
+// a job is finished: answer the client if it is still there
+static void complete(struct job *j)
+{
+  char line[LINE_LEN];
+  int n;
+
+  n = snprintf(line, sizeof(line), "R %ld %.9f %.0f %ld %.0f\n", j->id,
+               4 * j->hits / j->its, j->hits, j->its, seconds_since(&j->arrived) * 1e6);
+  if (conns[j->client].gen == j->gen)
+    reply(j->client, line, n);
+
+  active_jobs--;
+  jobs_done++;
+  free(j);
+
+} // end complete function
+
+// ---------------------------------------------------------------------
+
+int main( int argc, char** argv ) {
+
+  struct pollfd fds[MAX_CLIENTS + 2];
+  int slot[MAX_CLIENTS + 2];
+  pthread_t th;
+  struct job *done[MAX_BATCH];
+  long num_workers, i;
+  int lfd, nfds, c, fd, error;
+  ssize_t n;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: mcserv <addr> [workers]\n");
+    exit(1);
+  }
+  num_workers = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_workers < 1)
+    num_workers = 1;
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  if ((lfd = open_socket(argv[1], 1)) < 0) {
+    perror("mcserv: cannot listen");
+    exit(1);
+  }
+  if (pipe(done_pipe) != 0) {
+    perror("mcserv: pipe");
+    exit(1);
+  }
+  for (c = 0; c < MAX_CLIENTS; c++)
+    conns[c].fd = -1;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  // the pool lives as long as the server
+  for (i = 0; i < num_workers; i++) {
+    if ((error = pthread_create(&th, NULL, th_serve, NULL)) != 0)
+      exit(error);
+    pthread_detach(th);
+  }
+
+  while (!stopping) {
+    fds[0].fd = lfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = done_pipe[0];
+    fds[1].events = POLLIN;
+    nfds = 2;
+    for (c = 0; c < MAX_CLIENTS; c++) {
+      if (conns[c].fd >= 0) {
+        fds[nfds].fd = conns[c].fd;
+        fds[nfds].events = POLLIN;
+        slot[nfds++] = c;
+      }
+    }
+
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("mcserv: poll");
+      exit(1);
+    }
+
+    if (fds[1].revents & POLLIN) {
+      n = read(done_pipe[0], done, sizeof(done));
+      for (i = 0; i < n / (ssize_t) sizeof(struct job*); i++)
+        complete(done[i]);
+    }
+
+    for (i = 2; i < nfds; i++) {
+      c = slot[i];
+      if (conns[c].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      n = read(conns[c].fd, conns[c].buf + conns[c].len, sizeof(conns[c].buf) - conns[c].len);
+      if (n > 0) {
+        conns[c].len += n;
+        requests(c);
+      }
+      if (conns[c].fd >= 0 && (n <= 0 || conns[c].len == sizeof(conns[c].buf))) {
+        // gone, or sent a line longer than any request
+        close(conns[c].fd);
+        conns[c].fd = -1;
+        conns[c].gen++;
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      if ((fd = accept(lfd, NULL, NULL)) < 0)
+        continue;
+      for (c = 0; c < MAX_CLIENTS && conns[c].fd >= 0; c++)
+        ;
+      if (c == MAX_CLIENTS) {
+        close(fd);
+        continue;
+      }
+      conns[c].fd = fd;
+      conns[c].len = 0;
+    }
+  }
+
+  close(lfd);
+  if (strchr(argv[1], '/') != NULL)
+    unlink(argv[1]);
+  return 0;
+
+} // end main function
@@ -0,0 +1,176 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>     /* for the futex system call */
+#include <linux/futex.h>
+#include "cslock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+static int kind = CS_MUTEX;
+
+static const char *names[CS_NUM_KINDS] = { "mutex", "ttas", "ticket", "mcs", "futex" };
+
+/* each thread's MCS queue nodes, one per lock it holds or waits on */
+static __thread struct mcs_node mcs_pool[CS_MAX_HELD];
+
+int cs_select( const char *name ) {
+	int i;
+	for (i = 0; i < CS_NUM_KINDS; i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			kind = i;
+			return i;
+		}
+	}
+	return -1;
+} // end cs_select function
+
+const char* cs_name( int k ) {
+	return (k >= 0 && k < CS_NUM_KINDS) ? names[k] : "?";
+} // end cs_name function
+
+void cs_init( struct cs_lock *l ) {
+	memset(l, 0, sizeof(*l));
+	pthread_mutex_init(&(l->mutex), NULL);
+} // end cs_init function
+
+static void futex_wait( volatile int *addr, int val ) {
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake( volatile int *addr ) {
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void ttas_lock( struct cs_lock *l ) {
+	while (1)
+	{
+		// spin on a plain read so waiters do not bounce the cache line
+		while (__atomic_load_n(&(l->word), __ATOMIC_RELAXED) != 0)
+			cpu_relax();
+		if (__atomic_exchange_n(&(l->word), 1, __ATOMIC_ACQUIRE) == 0)
+			return;
+	}
+}
+
+static void ticket_lock( struct cs_lock *l ) {
+	unsigned int me = __atomic_fetch_add(&(l->next), 1, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&(l->serving), __ATOMIC_ACQUIRE) != me)
+		cpu_relax();
+}
+
+static void mcs_lock( struct cs_lock *l ) {
+	struct mcs_node *me = NULL, *prev;
+	int i;
+	for (i = 0; i < CS_MAX_HELD; i++)
+	{
+		if (!mcs_pool[i].in_use)
+		{
+			me = &(mcs_pool[i]);
+			break;
+		}
+	}
+	me->in_use = 1;
+	me->next = NULL;
+	me->locked = 1;
+	prev = __atomic_exchange_n(&(l->tail), me, __ATOMIC_ACQ_REL);
+	if (prev != NULL)
+	{
+		__atomic_store_n(&(prev->next), me, __ATOMIC_RELEASE);
+		while (__atomic_load_n(&(me->locked), __ATOMIC_ACQUIRE))
+			cpu_relax();
+	}
+	l->holder = me;
+}
+
+static void mcs_unlock( struct cs_lock *l ) {
+	struct mcs_node *me = l->holder, *succ, *expected = me;
+	succ = __atomic_load_n(&(me->next), __ATOMIC_ACQUIRE);
+	if (succ == NULL)
+	{
+		if (__atomic_compare_exchange_n(&(l->tail), &expected, NULL, 0,
+		                                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		{
+			me->in_use = 0;
+			return;
+		}
+		// someone is between swapping the tail and linking in
+		while ((succ = __atomic_load_n(&(me->next), __ATOMIC_ACQUIRE)) == NULL)
+			cpu_relax();
+	}
+	__atomic_store_n(&(succ->locked), 0, __ATOMIC_RELEASE);
+	me->in_use = 0;
+}
+
+/*
+ Spin-then-park lock (after Drepper, "Futexes Are Tricky"):
+ word is 0 when free, 1 when held, 2 when held and someone may
+ be asleep.  A short spin covers the usual one-store critical
+ section; only if that fails does the thread sleep in the kernel,
+ so oversubscribed runs do not burn their time slices spinning.
+
+ The spin budget adapts the way glibc's adaptive mutex does: it
+ is twice the lock's running mean of tries needed, plus a little,
+ capped at CS_SPIN.  A lock that is usually free at once keeps a
+ budget of a few tries; one whose waiters need longer earns more
+ spinning before they sleep.  spins is updated racily on purpose,
+ it is only a hint.
+ */
+static void futex_lock( struct cs_lock *l ) {
+	int i, c, max = 2 * l->spins + 10;
+	if (max > CS_SPIN)
+		max = CS_SPIN;
+	for (i = 0; i < max; i++)
+	{
+		c = 0;
+		if (__atomic_compare_exchange_n(&(l->word), &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			l->spins += (i - l->spins) / 8;
+			return;
+		}
+		cpu_relax();
+	}
+	l->spins += (max - l->spins) / 8;
+	c = __atomic_exchange_n(&(l->word), 2, __ATOMIC_ACQUIRE);
+	while (c != 0)
+	{
+		futex_wait(&(l->word), 2);
+		c = __atomic_exchange_n(&(l->word), 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void futex_unlock( struct cs_lock *l ) {
+	if (__atomic_exchange_n(&(l->word), 0, __ATOMIC_RELEASE) == 2)
+		futex_wake(&(l->word));
+}
+
+void cs_lock( struct cs_lock *l ) {
+	switch (kind)
+	{
+		case CS_TTAS:   ttas_lock(l); break;
+		case CS_TICKET: ticket_lock(l); break;
+		case CS_MCS:    mcs_lock(l); break;
+		case CS_FUTEX:  futex_lock(l); break;
+		default:        pthread_mutex_lock(&(l->mutex)); break;
+	}
+} // end cs_lock function
+
+void cs_unlock( struct cs_lock *l ) {
+	switch (kind)
+	{
+		case CS_TTAS:
+			__atomic_store_n(&(l->word), 0, __ATOMIC_RELEASE);
+			break;
+		case CS_TICKET:
+			__atomic_store_n(&(l->serving), l->serving + 1, __ATOMIC_RELEASE);
+			break;
+		case CS_MCS:    mcs_unlock(l); break;
+		case CS_FUTEX:  futex_unlock(l); break;
+		default:        pthread_mutex_unlock(&(l->mutex)); break;
+	}
+} // end cs_unlock function
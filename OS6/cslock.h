@@ -0,0 +1,52 @@
+#include <pthread.h>
+
+/**************************************************
+
+ Chopstick Locks:
+
+ The critical sections around the chopsticks are a single
+ store, so the lock used for them is pluggable.  All locks
+ in a run are of the same kind, chosen once with cs_select
+ before any lock is initialized.
+
+   mutex    default pthread_mutex_t
+   ttas     test-and-test-and-set spinlock
+   ticket   FIFO ticket spinlock
+   mcs      MCS queue lock (each waiter spins on its own node)
+   futex    spins briefly, then sleeps in the kernel (futex); the
+            spin budget adapts per lock to how long recent
+            acquisitions took
+
+ */
+
+#define CS_SPIN     100    /* futex lock: most tries before sleeping */
+#define CS_MAX_HELD 8      /* mcs: locks one thread may hold at once */
+
+enum cs_kind { CS_MUTEX, CS_TTAS, CS_TICKET, CS_MCS, CS_FUTEX, CS_NUM_KINDS };
+
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile int locked;
+	int in_use;
+};
+
+/* one lock per cache line, so neighbouring chopsticks do not share one */
+struct cs_lock {
+	pthread_mutex_t mutex;
+	volatile int word;               /* ttas, futex: 0 free, 1 held, 2 held with sleepers */
+	int spins;                       /* futex: running mean of tries it took to get */
+	volatile unsigned int next;      /* ticket: next ticket to hand out */
+	volatile unsigned int serving;   /* ticket: ticket now holding the lock */
+	struct mcs_node *volatile tail;  /* mcs: last waiter, NULL if free */
+	struct mcs_node *holder;         /* mcs: node of the current holder */
+} __attribute__((aligned(64)));
+
+/* Choose the lock kind by name; returns -1 for an unknown name. */
+int cs_select( const char *name );
+
+/* Name of a lock kind (for reports). */
+const char* cs_name( int kind );
+
+void cs_init( struct cs_lock *l );
+void cs_lock( struct cs_lock *l );
+void cs_unlock( struct cs_lock *l );
@@ -0,0 +1,428 @@
+#include "dpsim.h"
+#include "cslock.h"
+#include "dpgraph.h"
+#include <sched.h>         // for sched_yield()
+
+// ---------------------------------------------------------------------
+// building graphs
+// ---------------------------------------------------------------------
+
+// append resource r to worker w's set unless it is already there
+static void add_edge( struct dp_graph *g, int w, int r, int *count ) {
+	int i;
+	for (i = g->start[w]; i < g->start[w] + count[w]; i++)
+	{
+		if (g->res[i] == r) {return;}
+	}
+	g->res[g->start[w] + count[w]] = r;
+	count[w]++;
+}
+
+// allocate room for k resources per worker
+static void alloc_graph( struct dp_graph *g, int workers, int resources, int k ) {
+	int w;
+	g->workers = workers;
+	g->resources = resources;
+	g->start = malloc(sizeof(int) * (workers + 1));
+	g->res = malloc(sizeof(int) * (workers * k > 0 ? workers * k : 1));
+	for (w = 0; w <= workers; w++)
+	{
+		g->start[w] = w * k;
+	}
+}
+
+// close the gaps left by duplicate resources
+static void pack_graph( struct dp_graph *g, int *count ) {
+	int w, i, to = 0, from;
+	for (w = 0; w < g->workers; w++)
+	{
+		from = g->start[w];
+		g->start[w] = to;
+		for (i = 0; i < count[w]; i++)
+		{
+			g->res[to++] = g->res[from + i];
+		}
+	}
+	g->start[g->workers] = to;
+}
+
+static int load_graph( struct dp_graph *g, const char *path ) {
+	FILE *fp;
+	char line[4096], *p, *end;
+	int workers, resources, w = 0, *count, cap;
+	long v;
+
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	do {
+		if (fgets(line, sizeof(line), fp) == NULL)
+		{
+			fprintf(stderr, "%s: missing \"workers resources\" line\n", path);
+			fclose(fp);
+			return -1;
+		}
+	} while (line[0] == '#' || sscanf(line, "%d %d", &workers, &resources) != 2);
+	if (workers < 1 || resources < 1)
+	{
+		fprintf(stderr, "%s: need at least one worker and one resource\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	// sets can be any size, so grow the edge array as needed
+	cap = workers * 2;
+	g->workers = workers;
+	g->resources = resources;
+	g->start = malloc(sizeof(int) * (workers + 1));
+	g->res = malloc(sizeof(int) * cap);
+	count = calloc(workers, sizeof(int));
+	g->start[0] = 0;
+
+	while (w < workers && fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {continue;}
+		g->start[w] = w > 0 ? g->start[w - 1] + count[w - 1] : 0;
+		for (p = line; (v = strtol(p, &end, 10)), end != p; p = end)
+		{
+			if (v < 0 || v >= resources)
+			{
+				fprintf(stderr, "%s: worker %d needs resource %ld, out of range\n", path, w, v);
+				fclose(fp);
+				free(count);
+				dpg_free(g);
+				return -1;
+			}
+			if (g->start[w] + count[w] == cap)
+			{
+				cap *= 2;
+				g->res = realloc(g->res, sizeof(int) * cap);
+			}
+			add_edge(g, w, (int) v, count);
+		}
+		w++;
+	}
+	fclose(fp);
+	if (w < workers)
+	{
+		fprintf(stderr, "%s: %d workers declared, %d listed\n", path, workers, w);
+		free(count);
+		dpg_free(g);
+		return -1;
+	}
+	g->start[workers] = g->start[workers - 1] + count[workers - 1];
+	free(count);
+	return 0;
+}
+
+int dpg_make( struct dp_graph *g, const char *spec, unsigned int seed ) {
+	int a = 0, b = 0, k = 0, h = 0, w, *count;
+	char name[DPG_SPEC_LEN];
+
+	memset(g, 0, sizeof(*g));
+	if (strncmp(spec, "file:", 5) == 0)
+	{
+		return load_graph(g, spec + 5);
+	}
+	if (sscanf(spec, "%63[a-z]:%d:%d:%d:%d", name, &a, &b, &k, &h) < 2)
+	{
+		fprintf(stderr, "bad graph spec \"%s\"\n", spec);
+		return -1;
+	}
+
+	if (strcmp(name, "ring") == 0 && a >= 2)
+	{
+		alloc_graph(g, a, a, 2);
+		count = calloc(a, sizeof(int));
+		for (w = 0; w < a; w++)
+		{
+			add_edge(g, w, w, count);
+			add_edge(g, w, (w + 1) % a, count);
+		}
+	}
+	else if (strcmp(name, "grid") == 0 && a >= 1 && b >= 1)
+	{
+		alloc_graph(g, a * b, a * b, 3);
+		count = calloc(a * b, sizeof(int));
+		for (w = 0; w < a * b; w++)
+		{
+			add_edge(g, w, w, count);
+			add_edge(g, w, (w / b) * b + (w % b + 1) % b, count);
+			add_edge(g, w, (w + b) % (a * b), count);
+		}
+	}
+	else if ((strcmp(name, "random") == 0 || (strcmp(name, "hotspot") == 0 && h >= 1 && h <= b))
+	         && a >= 1 && k >= 1 && k <= b)
+	{
+		alloc_graph(g, a, b, k);
+		count = calloc(a, sizeof(int));
+		for (w = 0; w < a; w++)
+		{
+			if (name[0] == 'h')
+			{
+				add_edge(g, w, rand_r(&seed) % h, count);
+			}
+			while (count[w] < k)
+			{
+				add_edge(g, w, rand_r(&seed) % b, count);
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "bad graph spec \"%s\"\n", spec);
+		return -1;
+	}
+
+	pack_graph(g, count);
+	free(count);
+	return 0;
+} // end dpg_make function
+
+void dpg_free( struct dp_graph *g ) {
+	free(g->start);
+	free(g->res);
+	g->start = NULL;
+	g->res = NULL;
+} // end dpg_free function
+
+// ---------------------------------------------------------------------
+// running
+// ---------------------------------------------------------------------
+
+struct worker_stat {
+	long meals;
+	double wait_ns;
+	double max_wait_ns;
+} __attribute__((aligned(64)));
+
+static const struct dp_graph *graph;
+static int *order;                   // each worker's set in pick-up order
+static struct cs_lock *locks;
+static volatile int *owner;          // worker holding each resource, or -1
+static volatile int *waiting;        // resource each worker waits for, or -1
+static volatile int *victim;         // set by the monitor to break a cycle
+static struct worker_stat *wstats;
+static volatile int running;
+static long think, drink;
+
+static int by_id( const void *a, const void *b ) {
+	return *(const int*) a - *(const int*) b;
+}
+
+static double ns_between( struct timespec *t0, struct timespec *t1 ) {
+	return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static void put_down( int w, int held ) {
+	int i, r;
+	for (i = held - 1; i >= 0; i--)
+	{
+		r = order[graph->start[w] + i];
+		cs_lock(&(locks[r]));
+		owner[r] = -1;
+		cs_unlock(&(locks[r]));
+	}
+}
+
+/*
+ A deadlock victim that grabs its set again at once usually wins
+ the race against the worker it let go for, and the cycle comes
+ straight back.  So wait until one of the resources it let go has been
+ taken, or a random number of short naps have passed.
+ */
+static void back_off( int w, int held, unsigned int *seed ) {
+	int i, naps = 1 + rand_r(seed) % 16;
+	while (running && naps-- > 0)
+	{
+		for (i = 0; i < held; i++)
+		{
+			if (owner[order[graph->start[w] + i]] != -1) {return;}
+		}
+		delay(10000);
+	}
+}
+
+// pick up every resource of worker w; returns 0 if told to stop first
+static int pick_up( int w, unsigned int *seed ) {
+	int i, r, n = graph->start[w + 1] - graph->start[w], got;
+	for (i = 0; i < n; i++)
+	{
+		r = order[graph->start[w] + i];
+		while (1)
+		{
+			cs_lock(&(locks[r]));
+			if ((got = (owner[r] == -1)))
+			{
+				owner[r] = w;
+			}
+			waiting[w] = got ? -1 : r;
+			cs_unlock(&(locks[r]));
+			if (got) {break;}
+			if (!running || victim[w])
+			{
+				// stopping, or chosen to break a deadlock: start over
+				waiting[w] = -1;
+				put_down(w, i);
+				if (!running) {return 0;}
+				victim[w] = 0;
+				back_off(w, i, seed);
+				i = -1;
+				break;
+			}
+			sched_yield();
+		}
+	}
+	return 1;
+}
+
+static void* th_worker( void* th_args ) {
+	int w = (int)(long) th_args;
+	unsigned int seed = w + 1;
+	struct timespec t0, t1;
+	double waited;
+	while (running)
+	{
+		if (think > 0) delay(think);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (!pick_up(w, &seed)) {break;}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		waited = ns_between(&t0, &t1);
+		wstats[w].meals++;
+		wstats[w].wait_ns += waited;
+		if (waited > wstats[w].max_wait_ns) {wstats[w].max_wait_ns = waited;}
+		if (drink > 0) delay(drink);
+		put_down(w, graph->start[w + 1] - graph->start[w]);
+	}
+	return 0;
+}
+
+// who worker w is waiting for, or -1
+static int waits_for( int w ) {
+	int r = waiting[w], o;
+	if (r < 0) {return -1;}
+	o = owner[r];
+	return (o >= 0 && o != w) ? o : -1;
+}
+
+/*
+ Each worker waits for at most one other, so the wait-for graph
+ is a set of chains and cycles.  Walk each chain once, stamping
+ the workers with the chain's start; running into our own stamp
+ means a cycle.  Returns a worker on the cycle, or -1.
+ */
+static int find_cycle( int *stamp ) {
+	int s, w;
+	for (w = 0; w < graph->workers; w++) {stamp[w] = -1;}
+	for (s = 0; s < graph->workers; s++)
+	{
+		for (w = s; w >= 0 && stamp[w] < 0; w = waits_for(w))
+		{
+			stamp[w] = s;
+		}
+		if (w >= 0 && stamp[w] == s) {return w;}
+	}
+	return -1;
+}
+
+// lowest numbered worker on the cycle through w, if it is still a cycle
+static int confirm_cycle( int w ) {
+	int v = w, lowest = w, steps = 0;
+	do {
+		v = waits_for(v);
+		if (v < 0 || ++steps > graph->workers) {return -1;}
+		if (v < lowest) {lowest = v;}
+	} while (v != w);
+	return lowest;
+}
+
+int dpg_run( const struct dp_graph *g, enum dpg_policy policy, double seconds,
+             long think_ns, long eat_ns, struct dpg_stats *stats ) {
+	pthread_t *threads;
+	struct timespec start, now;
+	int *stamp, w, r, n;
+	long i;
+	double waited = 0;
+
+	graph = g;
+	think = think_ns;
+	drink = eat_ns;
+	n = g->start[g->workers];
+	order = malloc(sizeof(int) * (n > 0 ? n : 1));
+	memcpy(order, g->res, sizeof(int) * n);
+	if (policy == DPG_ORDERED)
+	{
+		for (w = 0; w < g->workers; w++)
+		{
+			qsort(order + g->start[w], g->start[w + 1] - g->start[w], sizeof(int), by_id);
+		}
+	}
+	locks = malloc(sizeof(struct cs_lock) * g->resources);
+	owner = malloc(sizeof(int) * g->resources);
+	for (r = 0; r < g->resources; r++)
+	{
+		cs_init(&(locks[r]));
+		owner[r] = -1;
+	}
+	waiting = malloc(sizeof(int) * g->workers);
+	victim = calloc(g->workers, sizeof(int));
+	wstats = calloc(g->workers, sizeof(struct worker_stat));
+	stamp = malloc(sizeof(int) * g->workers);
+	threads = malloc(sizeof(pthread_t) * g->workers);
+	for (w = 0; w < g->workers; w++) {waiting[w] = -1;}
+
+	memset(stats, 0, sizeof(*stats));
+	running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < g->workers; i++)
+	{
+		if (pthread_create(&(threads[i]), NULL, th_worker, (void*) i) != 0)
+		{
+			running = 0;
+			while (--i >= 0) {pthread_join(threads[i], NULL);}
+			return -1;
+		}
+	}
+
+	// the deadlock monitor
+	do {
+		delay(1000000);
+		if ((w = find_cycle(stamp)) >= 0)
+		{
+			delay(100000);   // a real deadlock is still there a moment later
+			if ((w = confirm_cycle(w)) >= 0 && !victim[w])
+			{
+				stats->deadlocks++;
+				victim[w] = 1;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (ns_between(&start, &now) < seconds * 1e9);
+
+	running = 0;
+	for (i = 0; i < g->workers; i++)
+	{
+		pthread_join(threads[i], NULL);
+		stats->meals += wstats[i].meals;
+		waited += wstats[i].wait_ns;
+		if (wstats[i].max_wait_ns / 1000 > stats->max_wait_us)
+		{
+			stats->max_wait_us = wstats[i].max_wait_ns / 1000;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stats->seconds = ns_between(&start, &now) / 1e9;
+	stats->mean_wait_us = stats->meals > 0 ? waited / stats->meals / 1000 : 0;
+
+	free(order);
+	free(locks);
+	free((void*) owner);
+	free((void*) waiting);
+	free((void*) victim);
+	free(wstats);
+	free(stamp);
+	free(threads);
+	return 0;
+} // end dpg_run function
@@ -0,0 +1,91 @@
+/**************************************************
+
+ Resource Graph Simulator (drinking philosophers)
+
+ A generalization of the dining philosophers ring: each
+ worker needs its own set of shared resources (bottles)
+ before it can drink.  The graph is bipartite, workers on
+ one side and resources on the other, stored as one list
+ of resources per worker.
+
+ */
+
+#define DPG_SPEC_LEN 256
+
+struct dp_graph {
+	int workers;
+	int resources;
+	int *start;        /* worker w needs res[start[w]] .. res[start[w+1]-1] */
+	int *res;
+};
+
+/* how a worker picks up its set */
+enum dpg_policy {
+	DPG_ORDERED,       /* in increasing resource id: cannot deadlock */
+	DPG_LISTED         /* in the order listed: hold and wait, can deadlock */
+};
+
+struct dpg_stats {
+	long meals;
+	double seconds;
+	double mean_wait_us;  /* from starting to pick up to holding everything */
+	double max_wait_us;
+	long deadlocks;       /* cycles found by the monitor and broken */
+};
+
+/**************************************************
+
+ Graph Function:
+ int dpg_make( struct dp_graph *g, const char *spec, unsigned int seed )
+
+ Builds a graph from a spec:
+
+   ring:N              the dining philosophers, worker i needs
+                       resources i and (i+1) % N
+   grid:R:C            R x C torus, the worker at each cell needs
+                       its cell and the cells right of and below it
+   random:W:R:K        W workers, each needs K distinct resources
+                       picked at random from R
+   hotspot:W:R:K:H     like random, but one of each worker's K
+                       resources is one of the first H (the hot ones)
+   file:<path>         first line "workers resources", then one line
+                       per worker listing its resource ids ('#' starts
+                       a comment line; blank lines are skipped)
+
+ seed drives the random generators.  Returns 0, or -1 with an
+ error printed for a bad spec or file.
+
+ */
+
+int dpg_make( struct dp_graph *g, const char *spec, unsigned int seed );
+
+void dpg_free( struct dp_graph *g );
+
+/**************************************************
+
+ Run Function:
+ int dpg_run( const struct dp_graph *g, enum dpg_policy policy,
+              double seconds, long think_ns, long eat_ns,
+              struct dpg_stats *stats )
+
+ Starts one thread per worker.  Each thinks for think_ns,
+ picks up its resources according to policy, drinks for
+ eat_ns and puts them all down again.  Each resource is a
+ slot guarded by a chopstick lock (see cslock.h) held only
+ for the single store, so picking up k resources is k short
+ critical sections whatever the set size.
+
+ Meanwhile the calling thread is the deadlock monitor, the
+ graph version of isdeadlocked: every waiting worker points
+ at the owner of the resource it waits for, and a cycle in
+ those pointers that is still there a moment later is a
+ deadlock.  The lowest numbered worker on the cycle puts
+ down what it holds and starts over.
+
+ After seconds all workers are stopped and stats filled in.
+ Returns 0, or -1 if the threads could not be created.
+
+ */
+
+int dpg_run( const struct dp_graph *g, enum dpg_policy policy, double seconds,
+             long think_ns, long eat_ns, struct dpg_stats *stats );
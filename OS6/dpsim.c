@@ -1,15 +1,51 @@
 #include "dpsim.h"
+#include "cslock.h"
+#include <signal.h>
+#include <sys/resource.h>  // for getrusage()
 
 //class notes
 //signal in pthread kill is the same as the signal looked at before (sigkill, #9)
 //maybe, he's not sure. So check on this
 
-static const unsigned int NUM_PHILOSOPHERS = 5;
-static const unsigned int NUM_CHOPSTICKS = 5;
+static unsigned int NUM_PHILOSOPHERS = 5;
+static unsigned int NUM_CHOPSTICKS = 5;
 
-static int chopsticks[5];
-static pthread_mutex_t mutex[5];
-static pthread_t philosophers[5];
+static int *chopsticks;
+static struct cs_lock *mutex;
+static pthread_t *philosophers;
+
+// meals eaten by each philosopher, one cache line each
+struct meal_count {
+	long n;
+} __attribute__((aligned(64)));
+static struct meal_count *meals;
+
+// benchmark mode: no delays, back off instead of deadlocking, stop on request
+static int bench = 0;
+static volatile int running = 1;
+
+int dp_init( int num_philosophers, const char *lock_name ) {
+	int i;
+	if (num_philosophers < 2 || cs_select(lock_name) < 0)
+	{
+		return -1;
+	}
+	free(chopsticks);
+	free(mutex);
+	free(philosophers);
+	free(meals);
+	NUM_PHILOSOPHERS = NUM_CHOPSTICKS = num_philosophers;
+	chopsticks = malloc(sizeof(int) * NUM_CHOPSTICKS);
+	mutex = malloc(sizeof(struct cs_lock) * NUM_CHOPSTICKS);
+	philosophers = malloc(sizeof(pthread_t) * NUM_PHILOSOPHERS);
+	meals = calloc(NUM_PHILOSOPHERS, sizeof(struct meal_count));
+	for (i = 0; i < NUM_CHOPSTICKS; i++)
+	{
+		chopsticks[i] = -1;
+		cs_init(&(mutex[i]));
+	}
+	return 0;
+} // end dp_init function
 
 int isdeadlocked(){
 	int i;
@@ -18,14 +54,18 @@ int isdeadlocked(){
 		// check see if everyone has a chopstick
 		if (chopsticks[i] == -1) {return 0;}
 		//check to see if someone is eating
-		else if (chopsticks[i] == chopsticks[(i +1) % 5]) {return 0;}
+		else if (chopsticks[i] == chopsticks[(i +1) % NUM_CHOPSTICKS]) {return 0;}
 	}
 	return 1;
 }
 
 void* th_main( void* th_main_args ) {
 	// 1. Initialize all element values in the chopsticks array to -1
-	int i;
+	long i;
+	if (chopsticks == NULL && dp_init(NUM_PHILOSOPHERS, "mutex") != 0)
+	{
+		exit(1);
+	}
 	for (i = 0; i < NUM_CHOPSTICKS; i++)
 	{
 		chopsticks[i] = -1;
@@ -52,7 +92,7 @@ void* th_main( void* th_main_args ) {
 		printf("Philosopher(s) ");
 		for (i = 0; i < NUM_CHOPSTICKS; i++)
 		{
-			if (chopsticks[i] == chopsticks[(i + 1) % 5]) printf("%d, ", i);
+			if (chopsticks[i] == chopsticks[(i + 1) % NUM_CHOPSTICKS]) printf("%ld, ", i);
 		}
 		printf("are eating\n");
 	}
@@ -68,15 +108,16 @@ void* th_main( void* th_main_args ) {
 
 void* th_phil( void* th_phil_args ) {
 	// 1. Get the philosopher id (hint: use th_phil_args)
-	int id = (int)th_phil_args;
+	int id = (int)(long)th_phil_args;
 	// 2. Execute an infinite loop that does the following:
-	while(1)
+	while(running)
 	{
 		// - call the delay function for thinking (you specify nanosec sleep value)
-		delay(150000); // thinking...
+		if (!bench) delay(150000); // thinking...
 		// - call the eat function (argument is the philosopher id)
 		eat(id);
 	}
+	return 0;
 } // end th_phil function
 
 // This function is provided to you (i.e. do not modify).
@@ -94,40 +135,99 @@ void delay( long nanosec ) {
 
 void eat( int phil_id ) {
 	//defining left chopstick for transparency
-	int left = (phil_id + 1) % 5;
+	int left = (phil_id + 1) % NUM_CHOPSTICKS;
 	//return if right chopstick is already taken
 	if (chopsticks[phil_id] != -1 && chopsticks[phil_id] != phil_id){return;}
 
-	pthread_mutex_lock(&(mutex[phil_id]));
+	cs_lock(&(mutex[phil_id]));
+	if (bench && chopsticks[phil_id] != -1 && chopsticks[phil_id] != phil_id){
+		// a neighbour took it as its left since the check above
+		cs_unlock(&(mutex[phil_id]));
+		return;
+	}
 	// pick up chopstick phil_id(i.e. the right chopstick)
 	chopsticks[phil_id] = phil_id;
-	pthread_mutex_unlock(&(mutex[phil_id]));
+	cs_unlock(&(mutex[phil_id]));
 
 	// delays for no more than 20,000 nanoseconds
-	delay(1000);
-	if (chopsticks[left] != -1){return;}
+	if (!bench) delay(1000);
+	if (chopsticks[left] != -1){
+		// when benchmarking, put the right chopstick back rather than deadlock
+		if (bench){
+			cs_lock(&(mutex[phil_id]));
+			chopsticks[phil_id] = -1;
+			cs_unlock(&(mutex[phil_id]));
+		}
+		return;
+	}
 
 	// pickup left chopstick
-	pthread_mutex_lock(&(mutex[left]));
+	cs_lock(&(mutex[left]));
+	if (bench && chopsticks[left] != -1){
+		// lost the race for it since the check above
+		cs_unlock(&(mutex[left]));
+		cs_lock(&(mutex[phil_id]));
+		chopsticks[phil_id] = -1;
+		cs_unlock(&(mutex[phil_id]));
+		return;
+	}
 	chopsticks[left] = phil_id;
-	pthread_mutex_unlock(&(mutex[left]));
+	cs_unlock(&(mutex[left]));
+	meals[phil_id].n++;
 
 	// After having picked up both chopsticks (as described) the philosopher will delay a
  	// number of nanoseconds that is determined by you experimentally.
-	delay(100000);
+	if (!bench) delay(100000);
 	// After the delay completes
 
 	//release left (since right was picked up first)
-	pthread_mutex_lock(&(mutex[left]));
+	cs_lock(&(mutex[left]));
 	chopsticks[left] = -1;
-	pthread_mutex_unlock(&(mutex[left]));
+	cs_unlock(&(mutex[left]));
 
 	// a delay here will make it easier to deadificate
-	delay(7500);
+	if (!bench) delay(7500);
 
 	//release right
-	pthread_mutex_lock(&(mutex[phil_id]));
+	cs_lock(&(mutex[phil_id]));
 	chopsticks[phil_id] = -1;
-	pthread_mutex_unlock(&(mutex[phil_id]));
+	cs_unlock(&(mutex[phil_id]));
 
 } // end eat function
+
+
+long dp_bench( int num_philosophers, const char *lock_name, double seconds, double *cpu_secs ) {
+	struct rusage before, after;
+	struct timespec t_spec;
+	long i, total = 0;
+	if (dp_init(num_philosophers, lock_name) != 0)
+	{
+		return -1;
+	}
+	bench = 1;
+	running = 1;
+	getrusage(RUSAGE_SELF, &before);
+	for (i = 0; i < NUM_PHILOSOPHERS; i++)
+	{
+		if (pthread_create(&(philosophers[i]), NULL, th_phil, (void*) i) != 0)
+		{
+			exit(1);
+		}
+	}
+	t_spec.tv_sec = (time_t) seconds;
+	t_spec.tv_nsec = (long) ((seconds - t_spec.tv_sec) * 1000000000);
+	nanosleep(&t_spec, NULL);
+	running = 0;
+	for (i = 0; i < NUM_PHILOSOPHERS; i++)
+	{
+		pthread_join(philosophers[i], NULL);
+		total += meals[i].n;
+	}
+	getrusage(RUSAGE_SELF, &after);
+	*cpu_secs = (after.ru_utime.tv_sec - before.ru_utime.tv_sec)
+	          + (after.ru_stime.tv_sec - before.ru_stime.tv_sec)
+	          + ((after.ru_utime.tv_usec - before.ru_utime.tv_usec)
+	          + (after.ru_stime.tv_usec - before.ru_stime.tv_usec)) / 1e6;
+	bench = 0;
+	return total;
+} // end dp_bench function
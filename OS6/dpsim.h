@@ -105,3 +105,36 @@ void delay( long nanosec );
  */
 
 void eat( int phil_id );
+
+/**************************************************
+ 
+ Setup Function:
+ int dp_init( int num_philosophers, const char *lock_name )
+ 
+ Sizes the table for num_philosophers philosophers (and as
+ many chopsticks, in a ring) and selects the chopstick lock
+ by name (see cslock.h).  Optional: th_main sets up 5
+ philosophers with pthread mutexes if this was not called.
+ Returns 0, or -1 for a bad count or lock name.
+ 
+ */
+
+int dp_init( int num_philosophers, const char *lock_name );
+
+/**************************************************
+ 
+ Benchmark Function:
+ long dp_bench( int num_philosophers, const char *lock_name,
+                double seconds, double *cpu_secs )
+ 
+ Runs num_philosophers philosophers with the named lock for
+ seconds, without any of the think or eat delays, so the
+ chopstick locks are as contended as they can be.  A
+ philosopher who finds their left chopstick taken puts the
+ right one back instead of holding it, so the run cannot
+ deadlock.  Returns the number of meals eaten (-1 on bad
+ arguments) and stores the CPU time used in *cpu_secs.
+ 
+ */
+
+long dp_bench( int num_philosophers, const char *lock_name, double seconds, double *cpu_secs );
@@ -1,7 +1,15 @@
 #include <stdio.h>
 #include "dpsim.h"
+#include "cslock.h"
+#include "dpgraph.h"
 #include <pthread.h>
 
+#define BENCH_SECONDS       1.0
+#define BENCH_MAX_PHIL     80
+#define GRAPH_SECONDS       2.0
+#define GRAPH_THINK_NS  20000
+#define GRAPH_EAT_NS    50000
+
 /**************************************************
 
 Main Function:
@@ -22,8 +30,116 @@ In this function perform the following steps:
 4. Display join status value.
 5. Exit program.
 
+Options:
+	./hw6 --lock <kind>
+		run the simulation with another chopstick lock
+		(mutex, ttas, ticket, mcs or futex)
+	./hw6 --bench [seconds] [max philosophers]
+		for every lock kind and 5, 10, 20, ... philosophers,
+		report meals per second and CPU time per meal
+	./hw6 --meals <kind> <philosophers> [seconds]
+		the same measurement for one lock kind and one table
+		size, printing the meal count (for bench/perfbench)
+	./hw6 --graph [--policy ordered|listed] [--lock <kind>]
+	              [--seconds s] [--think ns] [--eat ns] [--seed n]
+	              <spec> [<spec> ...]
+		run the drinking philosophers on each resource graph
+		(see dpgraph.h for the specs) and report throughput,
+		wait times and deadlocks per graph
+
 */
 
+static int run_graphs( int argc, char** argv ) {
+	enum dpg_policy policy = DPG_ORDERED;
+	double seconds = GRAPH_SECONDS;
+	long think_ns = GRAPH_THINK_NS, eat_ns = GRAPH_EAT_NS;
+	unsigned int seed = 1;
+	const char *lock = "mutex";
+	struct dp_graph g;
+	struct dpg_stats st;
+	int i, ran = 0;
+	for (i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "listed") == 0) {policy = DPG_LISTED;}
+			else if (strcmp(argv[i], "ordered") == 0) {policy = DPG_ORDERED;}
+			else
+			{
+				fprintf(stderr, "unknown policy %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--lock") == 0 && i + 1 < argc) {lock = argv[++i];}
+		else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {seconds = atof(argv[++i]);}
+		else if (strcmp(argv[i], "--think") == 0 && i + 1 < argc) {think_ns = atol(argv[++i]);}
+		else if (strcmp(argv[i], "--eat") == 0 && i + 1 < argc) {eat_ns = atol(argv[++i]);}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {seed = atoi(argv[++i]);}
+		else
+		{
+			if (cs_select(lock) < 0)
+			{
+				fprintf(stderr, "unknown lock %s\n", lock);
+				return 1;
+			}
+			if (dpg_make(&g, argv[i], seed) != 0) {return 1;}
+			if (dpg_run(&g, policy, seconds, think_ns, eat_ns, &st) != 0)
+			{
+				fprintf(stderr, "failed to start %d workers\n", g.workers);
+				return 1;
+			}
+			printf("%s: %d workers, %d resources, %d edges (%s, %s)\n"
+			       "\tmeals = %ld (%.0f per second)\n"
+			       "\tmean wait usec = %.1f\n\tmax wait usec = %.1f\n"
+			       "\tdeadlocks = %ld\n",
+			       argv[i], g.workers, g.resources, g.start[g.workers],
+			       policy == DPG_LISTED ? "listed" : "ordered", lock,
+			       st.meals, st.meals / st.seconds, st.mean_wait_us, st.max_wait_us,
+			       st.deadlocks);
+			fflush(stdout);
+			dpg_free(&g);
+			ran++;
+		}
+	}
+	if (!ran)
+	{
+		fprintf(stderr, "--graph needs at least one graph spec\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void run_bench( double seconds, int max_phil ) {
+	int kind, n;
+	long meals;
+	double cpu;
+	printf("%-8s %12s %14s %16s\n", "lock", "philosophers", "meals/sec", "cpu usec/meal");
+	for (kind = 0; kind < CS_NUM_KINDS; kind++)
+	{
+		for (n = 5; n <= max_phil; n *= 2)
+		{
+			meals = dp_bench(n, cs_name(kind), seconds, &cpu);
+			printf("%-8s %12d %14.0f %16.3f\n", cs_name(kind), n, meals / seconds,
+			       meals > 0 ? cpu * 1e6 / meals : 0.0);
+			fflush(stdout);
+		}
+	}
+}
+
+static int run_meals( const char *lock, int n, double seconds ) {
+	long meals;
+	double cpu;
+	if ((meals = dp_bench(n, lock, seconds, &cpu)) < 0)
+	{
+		fprintf(stderr, "unknown lock %s or fewer than 2 philosophers\n", lock);
+		return 1;
+	}
+	printf("meals = %ld\n\t%s, %d philosophers, %.0f per second, %.3f cpu usec/meal\n",
+	       meals, lock, n, meals / seconds, meals > 0 ? cpu * 1e6 / meals : 0.0);
+	return 0;
+}
+
 int main( int argc, char** argv ) {
 
 	// 1. Create the following variables:
@@ -31,6 +147,29 @@ int main( int argc, char** argv ) {
 	pthread_t main_thread;
 	// 	- status (join status value)
 	int status;
+
+	if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+	{
+		run_bench(argc > 2 ? atof(argv[2]) : BENCH_SECONDS,
+		          argc > 3 ? atoi(argv[3]) : BENCH_MAX_PHIL);
+		return 0;
+	}
+	if (argc >= 4 && strcmp(argv[1], "--meals") == 0)
+	{
+		return run_meals(argv[2], atoi(argv[3]), argc > 4 ? atof(argv[4]) : BENCH_SECONDS);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--graph") == 0)
+	{
+		return run_graphs(argc, argv);
+	}
+	if (argc >= 3 && strcmp(argv[1], "--lock") == 0)
+	{
+		if (dp_init(5, argv[2]) != 0)
+		{
+			fprintf(stderr, "unknown lock %s\n", argv[2]);
+			exit(1);
+		}
+	}
 	// 2. Create a main_thread
 	// 	- If the return value != 0, then display an error message and
 	// 	  immediately exit program with status value 1.
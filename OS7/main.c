@@ -1,16 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>   /* for UINT_MAX */
 
 #include "mem.h"
-
-
-/* minimum and maximum duration of use for an allocated block of memory */
-#define MIN_DURATION      3
-#define MAX_DURATION     25
-
-/* minimum and maximum allocation request size */
-#define MIN_REQUEST_SIZE    3
-#define MAX_REQUEST_SIZE  100
+#include "workload.h"
 
 /*
   The main program will accept four paramemters on the command line.
@@ -26,27 +19,49 @@
   1,000 units, perform 100 runs with each run taking 3000 units of
   time, and the random number generator should be seeded (one time)
   with the value 1235.
+
+  Three optional parameters choose the workload: the request size
+  distribution, the duration distribution and the correlation between
+  the two (see workload.h for the distribution names).  By default both
+  are uniform over the ranges in mem.h and independent.
+
+  ./hw7 1000 3000 100 1235 pareto:1.2@3-1000 lognormal 0.5
+
+  A comma separated spec makes a trace with phases (see workload.h);
+  an eighth parameter sets the number of requests per phase.
+
+  ./hw7 3000 3000 3 1235 uniform@737-999,uniform@3-100 uniform@3-3,uniform@3-25 0 3000
 */
 
 int main(int argc, char** argv){
-	int memsize, runs, iterations, seed, method, i, j, sizerange, durationrange, dur, siz, total_frags = 0, total_misses = 0, total_probes = 0, result;
+	unsigned long memsize;
+	char *end;
+	int runs, iterations, seed, method, i, j, total_frags = 0, total_misses = 0, total_probes = 0, result;
+	unsigned int dur, siz;
 	enum mem_strategies strategy;
 	char *strat_string;
-	if (argc != 5){
-    printf("expected 4 args, not %d\n", argc );
+	struct workload wl;
+	if (argc < 5 || argc > 9){
+    printf("expected 4 to 8 args, not %d\n", argc - 1);
 	  exit(1);
 	}
-	memsize = atoi(argv[1]);
+	memsize = strtoul(argv[1], &end, 10);
+	if (*end != '\0' || argv[1][0] == '-' || memsize == 0 || memsize > UINT_MAX){
+		fprintf(stderr, "memory size must be 1 to %u units, not %s\n", UINT_MAX, argv[1]);
+		exit(1);
+	}
   iterations = atoi(argv[2]);
 	runs = atoi(argv[3]);
 	seed = atoi(argv[4]);
 	mem_init(memsize);
 
-	srand(seed);
-	// then mult the percentages by the appropriate scale:
-	durationrange = MAX_DURATION - MIN_DURATION;
-	sizerange = MAX_REQUEST_SIZE - MIN_REQUEST_SIZE;
-	for (method = 0; method <= 2; method++){
+	for (method = 0; method <= 3; method++){
+		/* every strategy gets the same trace, phases and all */
+		if (workload_init(&wl, argc > 5 ? argv[5] : NULL, argc > 6 ? argv[6] : NULL,
+		                  argc > 7 ? atof(argv[7]) : 0.0,
+		                  argc > 8 ? atol(argv[8]) : WL_PHASE_LEN, seed) != 0){
+			exit(1);
+		}
 		total_frags = 0;
 		total_misses = 0;
 		total_probes = 0;
@@ -64,6 +79,10 @@ int main(int argc, char** argv){
 				strategy = BEST;
 				strat_string = "BESTFIT\0";
 				break;
+			case 3:
+				strategy = ADAPTIVE;
+				strat_string = "ADAPTIVE\0";
+				break;
 			default:
 				fprintf(stderr, "enum error, shouldn't happen\n");
 				exit(1);
@@ -72,8 +91,7 @@ int main(int argc, char** argv){
 
 			for (j = 0; j < iterations; j++){
 
-				dur = (rand() % (durationrange + 1)) + MIN_DURATION;
-   			siz = (rand() % (sizerange + 1)) + MIN_REQUEST_SIZE;
+				workload_next(&wl, &siz, &dur);
 				result = mem_allocate(strategy, siz, dur);
 
 				if (result == -1){
@@ -87,6 +105,10 @@ int main(int argc, char** argv){
 			total_frags += mem_fragment_count(3);
 		}
 	printf("%s:\n\tmean fragmentation count = %.3f\n\tmean number of fails = %.3f\n\tmean number of probes = %.5f\n", strat_string, ((double) total_frags) / ((double) runs), ((double) total_misses)/((double) runs), ((double) total_probes)/((double) runs));
+		if (strategy == ADAPTIVE){
+			mem_adaptive_print(20);
+		}
+		workload_free(&wl);
 
 	}
 	mem_free();
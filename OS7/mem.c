@@ -1,13 +1,40 @@
 #include <stdio.h>    /* for printf statements when debugging */
-#include <stdlib.h>   /* for malloc() and free() */
+#include <stdlib.h>   /* for exit() and realloc() */
+#include <limits.h>   /* for UINT_MAX */
+#include <sys/mman.h> /* for mmap() and madvise() */
 #include "mem.h"
 
+/*
+  Advice used to hand touched pages back to the kernel on mem_clear.
+  MADV_FREE is cheaper but the pages stay in RSS until there is memory
+  pressure; either is safe because of the clock (see below).
+ */
+#ifndef MEM_MADVISE
+#define MEM_MADVISE MADV_DONTNEED
+#endif
+
 /*
   Physical memory array. This is a static global array for all functions in this file.
-  An element in the array with a value of zero represents a free unit of memory.
+  Each element holds the time at which its unit becomes free again, so an element
+  is free when its value is at or below mem_clock.  Zero is therefore always free,
+  which is what untouched (or madvised) anonymous pages read as.
 */
 static unsigned int* memory;
 
+/*
+ The current simulated time.  Advancing it frees every unit whose time has come,
+ so a time unit transpiring costs nothing, and mem_clear only has to move it past
+ the latest expiry handed out.
+ */
+static unsigned int mem_clock;
+
+/*
+ The latest expiry time stored in memory, and one past the highest unit ever
+ written since the last mem_clear (the only pages that can be resident).
+ */
+static unsigned int max_expiry;
+static unsigned int high_water;
+
 /*
  The size (i.e. number of units) of the physical memory array. This is a static global
  variable used by functions in this file.
@@ -22,19 +49,66 @@ static unsigned int mem_size;
  */
 static unsigned int last_placement_position;
 
+/*
+ The ADAPTIVE strategy runs one of the fixed strategies for a window of
+ ADAPT_WINDOW allocations, charges it probes plus ADAPT_MISS_COST per miss,
+ and keeps an exponentially weighted mean of that cost per strategy.  At the
+ end of each window it moves to the cheapest strategy, so a phase change that
+ makes the current strategy expensive is noticed within a window or two.  A
+ challenger has to be ADAPT_MARGIN cheaper than the incumbent to take over,
+ so noise in one short window does not flip the policy back and forth.  A
+ strategy left idle for its exploration gap gets a short ADAPT_PROBE window to
+ refresh its estimate (a bad strategy can be very bad, e.g. BEST scans all of
+ memory); the gap starts at ADAPT_EXPLORE windows and doubles (up to
+ ADAPT_EXPLORE_MAX) each time the retry loses, so a strategy that is clearly
+ worse costs little.  A probe window is also cut short as soon as it has cost
+ more than the incumbent is expected to cost over the same window, so one
+ retry of a bad strategy costs about one of its allocations, not ADAPT_PROBE
+ of them.
+ */
+#define ADAPT_WINDOW        32
+#define ADAPT_PROBE          8
+#define ADAPT_MISS_COST      1
+#define ADAPT_EXPLORE        8
+#define ADAPT_EXPLORE_MAX 1024
+#define ADAPT_MARGIN       0.1
+#define ADAPT_ALPHA        0.7
+#define ADAPT_POLICIES     3
+
+/* one entry per change of policy: the allocation it started at */
+struct adapt_segment {
+	unsigned long start;
+	mem_strategy_t policy;
+};
+
+static mem_strategy_t adapt_policy;
+static mem_strategy_t adapt_best;                  /* the incumbent */
+static double adapt_cost[ADAPT_POLICIES];          /* negative until tried */
+static unsigned long adapt_last_used[ADAPT_POLICIES];
+static unsigned long adapt_gap[ADAPT_POLICIES];
+static unsigned long adapt_share[ADAPT_POLICIES];  /* allocations per policy */
+static unsigned long adapt_window;
+static unsigned long adapt_allocs;
+static int adapt_count, adapt_len;
+static long adapt_window_cost;
+static struct adapt_segment *adapt_log;
+static int adapt_log_len, adapt_log_cap;
+
+static const char *strategy_names[] = { "FIRST", "NEXT", "BEST", "ADAPTIVE" };
+
 void print_mem(){
-	int i;
+	unsigned int i;
 	printf("memory: ");
 	for (i = 0; i < mem_size; i++){
-		printf("%d ", memory[i]);
+		printf("%u ", memory[i] > mem_clock ? memory[i] - mem_clock : 0);
 	}
 	printf("\n");
 }
 
-int getchunk(int startindex){
-	int i, cursize = 0;
+unsigned int getchunk(unsigned int startindex){
+	unsigned int i, cursize = 0;
 	for (i = startindex; i < mem_size; i++){
-		if (memory[i] == 0){
+		if (memory[i] <= mem_clock){
 			cursize++;
 		}
 		else break;
@@ -42,33 +116,59 @@ int getchunk(int startindex){
 	return cursize;
 }
 
-int getfirstempty(){
-	int i;
+/* index of the first free unit, or mem_size if there is none */
+unsigned int getfirstempty(){
+	unsigned int i;
 	for (i = 0; i < mem_size; i++){
-		if (memory[i] == 0){
+		if (memory[i] <= mem_clock){
 			return i;
 		}
 	}
-	return -1;
+	return mem_size;
 }
 
-void allocate(int size, int duration, int startindex){
-	int x;
+void allocate(unsigned int size, unsigned int duration, unsigned int startindex){
+	unsigned int x;
+	unsigned int expiry = mem_clock + duration;
 	for (x = 0; x < size; x++){
-		memory[startindex + x] = duration;
+		memory[startindex + x] = expiry;
+	}
+	if (expiry > max_expiry){
+		max_expiry = expiry;
+	}
+	if (startindex + size > high_water){
+		high_water = startindex + size;
+	}
+}
+
+/*
+  Called before mem_clock + duration would overflow: rewrite every unit
+  relative to a clock of zero.  This is the only full pass left and it
+  happens at most once every few billion time units.  Units that are already
+  zero are not written so untouched pages stay unmapped.
+ */
+static void rebase_clock(){
+	unsigned int i;
+	for (i = 0; i < mem_size; i++){
+		if (memory[i] != 0){
+			memory[i] = memory[i] > mem_clock ? memory[i] - mem_clock : 0;
+		}
 	}
+	max_expiry = max_expiry > mem_clock ? max_expiry - mem_clock : 0;
+	mem_clock = 0;
 }
 
-int firstfit(int size, int duration){
-	int i, chunksize, done = 0, tries = 0;
+int firstfit(unsigned int size, unsigned int duration){
+	unsigned int i, chunksize;
+	int done = 0, tries = 0;
 	i = getfirstempty();
-	if (i == -1){
+	if (i == mem_size){
 		// no free slots, return -1 for failure to allocate
 		return -1;
 	}
 	while (i < mem_size && !done){
 		chunksize = getchunk(i);
-		if (chunksize <= 0){
+		if (chunksize == 0){
 			i++;
 			//return -1;
 		}
@@ -90,12 +190,13 @@ int firstfit(int size, int duration){
 	}
 }
 
-int nextfit(int size, int duration){
-	int i, chunksize, done = 0, tries = 0, hitend = 0;
+int nextfit(unsigned int size, unsigned int duration){
+	unsigned int i, chunksize;
+	int done = 0, tries = 0, hitend = 0;
 	i = last_placement_position;
 	while (i < mem_size && !done){
 		chunksize = getchunk(i);
-		if (chunksize <= 0){
+		if (chunksize == 0){
 			i++;
 		}
 		else if (chunksize >= size){
@@ -120,19 +221,21 @@ int nextfit(int size, int duration){
 	}
 }
 
-int bestfit(int size, int duration){
-   int i, chunksize, found = 0, bestindex, bestsize = mem_size + 1, tries = 0;
+int bestfit(unsigned int size, unsigned int duration){
+   unsigned int i, chunksize, bestindex = 0, bestsize = 0;
+   int found = 0, tries = 0;
    i = getfirstempty();
    while (i < mem_size){
       chunksize = getchunk(i);
-      if (chunksize <= 0){
+      if (chunksize == 0){
          i++;
       }
       else if (chunksize == size){
-         found = 1;
-         return i;
+         // an exact fit cannot be beaten
+         allocate(size, duration, i);
+         return tries;
       }
-      else if (chunksize > size && chunksize < bestsize){
+      else if (chunksize > size && (!found || chunksize < bestsize)){
          bestindex = i;
          bestsize = chunksize;
 			found = 1;
@@ -152,6 +255,134 @@ int bestfit(int size, int duration){
 		return -1;
 	}
 }
+static void adapt_reset(){
+	int p;
+	for (p = 0; p < ADAPT_POLICIES; p++){
+		adapt_cost[p] = -1;
+		adapt_last_used[p] = 0;
+		adapt_gap[p] = ADAPT_EXPLORE;
+		adapt_share[p] = 0;
+	}
+	adapt_policy = FIRST;
+	adapt_best = FIRST;
+	adapt_window = 0;
+	adapt_allocs = 0;
+	adapt_count = 0;
+	adapt_len = ADAPT_WINDOW;
+	adapt_window_cost = 0;
+	adapt_log_len = 0;
+}
+
+static void adapt_record(){
+	if (adapt_log_len > 0 && adapt_log[adapt_log_len - 1].policy == adapt_policy){
+		return;
+	}
+	if (adapt_log_len == adapt_log_cap){
+		adapt_log_cap = adapt_log_cap ? adapt_log_cap * 2 : 64;
+		adapt_log = realloc(adapt_log, sizeof(struct adapt_segment) * adapt_log_cap);
+	}
+	adapt_log[adapt_log_len].start = adapt_allocs;
+	adapt_log[adapt_log_len].policy = adapt_policy;
+	adapt_log_len++;
+}
+
+/* pick the policy and length of the next window */
+static mem_strategy_t adapt_choose(){
+	int p, best = 0;
+	adapt_len = ADAPT_PROBE;
+	for (p = 0; p < ADAPT_POLICIES; p++){
+		if (adapt_cost[p] < 0){
+			return p;
+		}
+	}
+	for (p = 1; p < ADAPT_POLICIES; p++){
+		if (adapt_cost[p] < adapt_cost[best]){
+			best = p;
+		}
+	}
+	/* the incumbent keeps its place unless it is clearly beaten */
+	if (best != adapt_best && !(adapt_cost[best] < (1 - ADAPT_MARGIN) * adapt_cost[adapt_best])){
+		best = adapt_best;
+	}
+	/* a retry that did not come out on top waits twice as long next time */
+	if (best != adapt_policy && adapt_gap[adapt_policy] < ADAPT_EXPLORE_MAX){
+		adapt_gap[adapt_policy] *= 2;
+	}
+	adapt_gap[best] = ADAPT_EXPLORE;
+	adapt_best = best;
+	for (p = 0; p < ADAPT_POLICIES; p++){
+		if (p != best && adapt_window - adapt_last_used[p] > adapt_gap[p]){
+			return p;
+		}
+	}
+	adapt_len = ADAPT_WINDOW;
+	return best;
+}
+
+int adaptive(unsigned int size, unsigned int duration){
+	int result;
+	double cost;
+
+	if (adapt_count == 0){
+		adapt_record();
+	}
+	switch (adapt_policy){
+		case FIRST:
+			result = firstfit(size, duration);
+			break;
+		case NEXT:
+			result = nextfit(size, duration);
+			break;
+		default:
+			result = bestfit(size, duration);
+			break;
+	}
+	adapt_window_cost += result == -1 ? ADAPT_MISS_COST : result;
+	adapt_share[adapt_policy]++;
+	adapt_allocs++;
+
+	adapt_count++;
+	/* a retry already dearer than the incumbent's whole window has lost */
+	if (adapt_policy != adapt_best && adapt_cost[adapt_best] >= 0
+	    && adapt_window_cost > adapt_cost[adapt_best] * adapt_len + ADAPT_MISS_COST){
+		adapt_len = adapt_count;
+	}
+	if (adapt_count == adapt_len){
+		cost = (double) adapt_window_cost / adapt_count;
+		if (adapt_cost[adapt_policy] < 0){
+			adapt_cost[adapt_policy] = cost;
+		}
+		else {
+			adapt_cost[adapt_policy] = ADAPT_ALPHA * cost + (1 - ADAPT_ALPHA) * adapt_cost[adapt_policy];
+		}
+		adapt_last_used[adapt_policy] = ++adapt_window;
+		adapt_policy = adapt_choose();
+		adapt_count = 0;
+		adapt_window_cost = 0;
+	}
+	return result;
+}
+
+/*
+  Print which fixed strategy the ADAPTIVE strategy used: the share of
+  allocations each one handled, and the allocation number at which each
+  of the first max_segments policy changes happened.
+ */
+void mem_adaptive_print(int max_segments){
+	int p, i;
+	double total = adapt_allocs ? (double) adapt_allocs : 1.0;
+
+	printf("\tpolicy share =");
+	for (p = 0; p < ADAPT_POLICIES; p++){
+		printf(" %s %.1f%%", strategy_names[p], 100.0 * adapt_share[p] / total);
+	}
+	printf(" (%d switches)\n\tpolicy timeline =", adapt_log_len > 0 ? adapt_log_len - 1 : 0);
+	for (i = 0; i < adapt_log_len && i < max_segments; i++){
+		printf(" %lu:%s", adapt_log[i].start, strategy_names[adapt_log[i].policy]);
+	}
+	printf("%s\n", adapt_log_len > max_segments ? " ..." : "");
+}
+
 /*
   Using the memory placement algorithm, strategy, allocate size
   units of memory that will reside in memory for duration time units.
@@ -167,6 +398,9 @@ int bestfit(int size, int duration){
 int mem_allocate(mem_strategy_t strategy, unsigned int size, unsigned int duration){
 	int result;
 
+	if (duration > UINT_MAX - mem_clock){
+		rebase_clock();
+	}
 	switch (strategy){
 		case FIRST:
 			result = firstfit(size, duration);
@@ -177,6 +411,9 @@ int mem_allocate(mem_strategy_t strategy, unsigned int size, unsigned int durati
 		case BEST:
 			result = bestfit(size, duration);
 			break;
+		case ADAPTIVE:
+			result = adaptive(size, duration);
+			break;
 		default:
 			exit(1);
 	}
@@ -184,16 +421,15 @@ int mem_allocate(mem_strategy_t strategy, unsigned int size, unsigned int durati
 }
 
 /*
-  Go through all of memory and decrement all positive-valued entries.
-  This simulates one unit of time having transpired.
+  Advance the clock by one.  Every entry whose expiry time is reached is
+  free from now on without being touched.  This simulates one unit of time
+  having transpired.
  */
 int mem_single_time_unit_transpired(){
-	int i;
-	for (i = 0; i < mem_size; i++){
-		if (memory[i] > 0){
-			memory[i]--;
-		}
+	if (mem_clock == UINT_MAX){
+		rebase_clock();
 	}
+	mem_clock++;
 	return 0; // ???
 }
 
@@ -203,14 +439,15 @@ int mem_single_time_unit_transpired(){
   frag_size.
  */
 int mem_fragment_count(int frag_size){
-	int cursize = 0, i, count = 0;
+	unsigned int cursize = 0, i;
+	int count = 0;
 	for (i = 0; i < mem_size; i++){
-		if (memory[i] == 0){
+		if (memory[i] <= mem_clock){
 			// still in a chunk
 			cursize++;
 		}
 		else{
-			if (cursize <= frag_size && cursize > 0){
+			if (cursize > 0 && frag_size >= 0 && cursize <= (unsigned int) frag_size){
 				count++;
 			}
 			cursize = 0;
@@ -220,12 +457,15 @@ int mem_fragment_count(int frag_size){
 }
 
 /*
-  Set the value of zero to all entries of memory.
+  Free all entries of memory.  Moving the clock to the latest expiry frees
+  everything in constant time; the touched pages are then given back to the
+  kernel so the next run starts with an empty resident set.
  */
 void mem_clear(){
-	int i;
-	for (i = 0; i < mem_size; i++){
-		memory[i] = 0;
+	mem_clock = max_expiry;
+	if (high_water > 0){
+		madvise(memory, sizeof(unsigned int) * (size_t) high_water, MEM_MADVISE);
+		high_water = 0;
 	}
 	last_placement_position = 0;
 }
@@ -233,13 +473,23 @@ void mem_clear(){
 /*
  Allocate physical memory to size. This function should
  only be called once near the beginning of your main function.
+ The memory is anonymous and zero-filled, so pages only become
+ resident once an allocation lands on them.
  */
 void mem_init( unsigned int size )
 {
-	memory = malloc( sizeof(unsigned int)*size );
+	memory = mmap(NULL, sizeof(unsigned int) * (size_t) size, PROT_READ | PROT_WRITE,
+	              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (memory == MAP_FAILED){
+		perror("mem_init: mmap");
+		exit(1);
+	}
 	mem_size = size;
+	mem_clock = 0;
+	max_expiry = 0;
+	high_water = 0;
 	last_placement_position = 0;
-	mem_clear();
+	adapt_reset();
 }
 
 /*
@@ -247,5 +497,8 @@ void mem_init( unsigned int size )
  only be called once near the end of your main function.
  */
 void mem_free(){
-	free( memory );
+	munmap(memory, sizeof(unsigned int) * (size_t) mem_size);
+	free(adapt_log);
+	adapt_log = NULL;
+	adapt_log_cap = 0;
 }
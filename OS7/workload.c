@@ -0,0 +1,425 @@
+#include <stdio.h>    /* for fopen() and error messages */
+#include <stdlib.h>   /* for malloc() and free() */
+#include <string.h>
+#include <math.h>     /* for exp(), log(), pow() */
+#include "mem.h"
+#include "workload.h"
+
+#define WL_SPEC_LEN 256
+#define WL_MAX_PARAMS 4
+
+/*
+  xorshift64* generator.  Much cheaper than rand() and the whole 64 bit
+  output is usable: the high half picks an alias column and the low
+  half is the coin flip.
+ */
+static wl_u64 wl_rand(struct workload *wl){
+	wl_u64 x = wl->rng;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	wl->rng = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+  Spread a small seed over all 64 bits (splitmix64 finaliser) so that
+  nearby seeds give unrelated streams and the state is never zero.
+ */
+static wl_u64 wl_seed(unsigned int seed){
+	wl_u64 z = (wl_u64) seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+/*
+  Build the alias table for weights w[0..n-1] using Vose's method.
+  Returns -1 if a weight is negative or they do not sum to something
+  positive.
+ */
+static int alias_build(struct wl_alias *t, int min, const double *w, int n){
+	int i, s, l, nsmall = 0, nlarge = 0;
+	int *small, *large;
+	double total = 0, cum = 0, *p;
+
+	for (i = 0; i < n; i++){
+		if (!(w[i] >= 0)){
+			return -1;
+		}
+		total += w[i];
+	}
+	if (!(total > 0)){
+		return -1;
+	}
+
+	t->min = min;
+	t->n = n;
+	t->prob = malloc(sizeof(unsigned int) * n);
+	t->alias = malloc(sizeof(int) * n);
+	t->cdf = malloc(sizeof(double) * n);
+	p = malloc(sizeof(double) * n);
+	small = malloc(sizeof(int) * n);
+	large = malloc(sizeof(int) * n);
+
+	for (i = 0; i < n; i++){
+		cum += w[i];
+		t->cdf[i] = cum / total;
+		p[i] = w[i] * n / total;
+		if (p[i] < 1.0){
+			small[nsmall++] = i;
+		}
+		else {
+			large[nlarge++] = i;
+		}
+	}
+
+	while (nsmall > 0 && nlarge > 0){
+		s = small[--nsmall];
+		l = large[--nlarge];
+		t->prob[s] = (unsigned int) (p[s] * 4294967296.0);
+		t->alias[s] = l;
+		p[l] = (p[l] + p[s]) - 1.0;
+		if (p[l] < 1.0){
+			small[nsmall++] = l;
+		}
+		else {
+			large[nlarge++] = l;
+		}
+	}
+	/* whatever is left is 1.0 up to rounding error */
+	while (nlarge > 0){
+		l = large[--nlarge];
+		t->prob[l] = 0xFFFFFFFFu;
+		t->alias[l] = l;
+	}
+	while (nsmall > 0){
+		s = small[--nsmall];
+		t->prob[s] = 0xFFFFFFFFu;
+		t->alias[s] = s;
+	}
+
+	free(p);
+	free(small);
+	free(large);
+	return 0;
+}
+
+/* Draw a column index from an alias table with a single PRNG value. */
+static int alias_sample(const struct wl_alias *t, wl_u64 r){
+	int col = (int) (((r >> 32) * (wl_u64) t->n) >> 32);
+	if ((unsigned int) r < t->prob[col]){
+		return col;
+	}
+	return t->alias[col];
+}
+
+static void alias_free(struct wl_alias *t){
+	free(t->prob);
+	free(t->alias);
+	free(t->cdf);
+	t->prob = NULL;
+	t->alias = NULL;
+	t->cdf = NULL;
+}
+
+/*
+  Read an empirical histogram: one "value weight" pair per line, blank
+  lines and lines starting with '#' are ignored.  Values may repeat
+  (their weights add up) and need not be sorted.
+ */
+static int load_histogram(const char *path, int *min, double **w, int *n){
+	FILE *fp;
+	char line[WL_SPEC_LEN];
+	int value, lo = 0, hi = 0, have = 0;
+	double weight;
+
+	if ((fp = fopen(path, "r")) == NULL){
+		fprintf(stderr, "cannot open histogram %s\n", path);
+		return -1;
+	}
+	/* first pass finds the range, second pass fills it in */
+	while (fgets(line, sizeof(line), fp) != NULL){
+		if (line[0] == '#' || sscanf(line, "%d %lf", &value, &weight) != 2){
+			continue;
+		}
+		if (value < 1 || weight < 0){
+			fprintf(stderr, "bad histogram entry in %s: %s", path, line);
+			fclose(fp);
+			return -1;
+		}
+		if (!have || value < lo) lo = value;
+		if (!have || value > hi) hi = value;
+		have = 1;
+	}
+	if (!have){
+		fprintf(stderr, "histogram %s has no entries\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	*min = lo;
+	*n = hi - lo + 1;
+	*w = calloc(*n, sizeof(double));
+	rewind(fp);
+	while (fgets(line, sizeof(line), fp) != NULL){
+		if (line[0] == '#' || sscanf(line, "%d %lf", &value, &weight) != 2){
+			continue;
+		}
+		(*w)[value - lo] += weight;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/*
+  Turn a distribution spec (see workload.h) into a weight per integer
+  value.  dmin and dmax are the range used when the spec gives none.
+ */
+static int spec_weights(const char *spec, int dmin, int dmax, int *min, double **w, int *n){
+	char buf[WL_SPEC_LEN], *name, *tok, *range;
+	double prm[WL_MAX_PARAMS], x, lmin, lmax, z1, z2;
+	int nprm = 0, lo = dmin, hi = dmax, i;
+
+	if (spec == NULL){
+		spec = "uniform";
+	}
+	if (strncmp(spec, "file:", 5) == 0){
+		return load_histogram(spec + 5, min, w, n);
+	}
+
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	if ((range = strchr(buf, '@')) != NULL){
+		*range++ = '\0';
+		if (sscanf(range, "%d-%d", &lo, &hi) != 2){
+			fprintf(stderr, "bad range in \"%s\", expected @min-max\n", spec);
+			return -1;
+		}
+	}
+	if (lo < 1 || hi < lo){
+		fprintf(stderr, "bad range %d-%d in \"%s\"\n", lo, hi, spec);
+		return -1;
+	}
+	name = strtok(buf, ":");
+	while ((tok = strtok(NULL, ":")) != NULL && nprm < WL_MAX_PARAMS){
+		prm[nprm++] = atof(tok);
+	}
+	if (name == NULL){
+		name = "uniform";
+	}
+
+	*min = lo;
+	*n = hi - lo + 1;
+	*w = malloc(sizeof(double) * *n);
+	lmin = log((double) lo);
+	lmax = log((double) hi);
+
+	if (strcmp(name, "uniform") == 0){
+		for (i = 0; i < *n; i++){
+			(*w)[i] = 1.0;
+		}
+	}
+	else if (strcmp(name, "lognormal") == 0){
+		double mu = nprm > 0 ? prm[0] : lmin + (lmax - lmin) / 3;
+		double sigma = nprm > 1 ? prm[1] : (lmax - lmin) / 3;
+		if (!(sigma > 0)) sigma = 1.0;
+		for (i = 0; i < *n; i++){
+			x = lo + i;
+			z1 = (log(x) - mu) / sigma;
+			(*w)[i] = exp(-0.5 * z1 * z1) / x;
+		}
+	}
+	else if (strcmp(name, "pareto") == 0){
+		double alpha = nprm > 0 ? prm[0] : 1.5;
+		if (!(alpha > 0)) alpha = 1.5;
+		for (i = 0; i < *n; i++){
+			x = (double) (lo + i) / lo;
+			(*w)[i] = pow(x, -(alpha + 1));
+		}
+	}
+	else if (strcmp(name, "bimodal") == 0){
+		double m1 = nprm > 0 ? prm[0] : lo + (hi - lo) / 5.0;
+		double m2 = nprm > 1 ? prm[1] : hi - (hi - lo) / 5.0;
+		double spread = nprm > 2 ? prm[2] : (hi - lo) / 10.0;
+		double p1 = nprm > 3 ? prm[3] : 0.7;
+		if (!(spread > 0)) spread = 1.0;
+		if (!(p1 >= 0 && p1 <= 1)){
+			fprintf(stderr, "bimodal weight must be in [0, 1], not %g\n", p1);
+			free(*w);
+			*w = NULL;
+			return -1;
+		}
+		for (i = 0; i < *n; i++){
+			x = lo + i;
+			z1 = (x - m1) / spread;
+			z2 = (x - m2) / spread;
+			(*w)[i] = p1 * exp(-0.5 * z1 * z1) + (1 - p1) * exp(-0.5 * z2 * z2);
+		}
+	}
+	else {
+		fprintf(stderr, "unknown distribution \"%s\"\n", name);
+		free(*w);
+		*w = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int build_dimension(struct wl_alias *t, const char *spec, int dmin, int dmax){
+	int min, n;
+	double *w = NULL;
+
+	if (spec_weights(spec, dmin, dmax, &min, &w, &n) != 0){
+		return -1;
+	}
+	if (alias_build(t, min, w, n) != 0){
+		fprintf(stderr, "distribution \"%s\" has negative weights or no mass in its range\n", spec);
+		free(w);
+		return -1;
+	}
+	free(w);
+	return 0;
+}
+
+/*
+  Copy the index-th entry of a comma separated list into buf, or the last
+  entry if the list is shorter.  Returns the number of entries.
+ */
+static int spec_entry(const char *list, int index, char *buf, size_t len){
+	const char *p = list, *comma;
+	int count = 0;
+	size_t n;
+
+	buf[0] = '\0';
+	while (1){
+		comma = strchr(p, ',');
+		n = comma ? (size_t) (comma - p) : strlen(p);
+		if (count <= index){
+			if (n >= len) n = len - 1;
+			memcpy(buf, p, n);
+			buf[n] = '\0';
+		}
+		count++;
+		if (comma == NULL) break;
+		p = comma + 1;
+	}
+	return count;
+}
+
+/*
+  For each size, precompute the duration at the same (or mirrored)
+  quantile so a correlated draw is a lookup, not a search.
+ */
+static void correlate(struct wl_phase *ph, double corr){
+	int i, j = 0;
+	double u;
+
+	ph->dur_for_size = malloc(sizeof(int) * ph->size.n);
+	for (i = 0; i < ph->size.n; i++){
+		u = (ph->size.cdf[i] + (i > 0 ? ph->size.cdf[i - 1] : 0)) / 2;
+		if (corr < 0){
+			u = 1 - u;
+			j = 0;   /* quantiles run backwards, restart the scan */
+		}
+		while (j < ph->dur.n - 1 && ph->dur.cdf[j] < u){
+			j++;
+		}
+		ph->dur_for_size[i] = j;
+	}
+}
+
+int workload_init(struct workload *wl, const char *size_spec, const char *dur_spec,
+                  double corr, long phase_len, unsigned int seed){
+	char spec[WL_SPEC_LEN];
+	int i, nsize, ndur;
+	struct wl_phase *ph;
+
+	memset(wl, 0, sizeof(*wl));
+	if (corr < -1 || corr > 1){
+		fprintf(stderr, "correlation must be in [-1, 1], not %g\n", corr);
+		return -1;
+	}
+	if (size_spec == NULL) size_spec = "uniform";
+	if (dur_spec == NULL) dur_spec = "uniform";
+	nsize = spec_entry(size_spec, 0, spec, sizeof(spec));
+	ndur = spec_entry(dur_spec, 0, spec, sizeof(spec));
+	wl->phases = nsize > ndur ? nsize : ndur;
+	if (wl->phases > WL_MAX_PHASES){
+		fprintf(stderr, "at most %d phases, not %d\n", WL_MAX_PHASES, wl->phases);
+		return -1;
+	}
+	if (wl->phases > 1 && phase_len < 1){
+		fprintf(stderr, "phase length must be positive, not %ld\n", phase_len);
+		return -1;
+	}
+
+	for (i = 0; i < wl->phases; i++){
+		ph = &wl->phase[i];
+		spec_entry(size_spec, i, spec, sizeof(spec));
+		if (build_dimension(&ph->size, spec, MIN_REQUEST_SIZE, MAX_REQUEST_SIZE) != 0){
+			workload_free(wl);
+			return -1;
+		}
+		spec_entry(dur_spec, i, spec, sizeof(spec));
+		if (build_dimension(&ph->dur, spec, MIN_DURATION, MAX_DURATION) != 0){
+			workload_free(wl);
+			return -1;
+		}
+		if (corr != 0){
+			correlate(ph, corr);
+		}
+	}
+
+	wl->rng = wl_seed(seed);
+	wl->corr = corr;
+	wl->corr_cut = (unsigned int) (fabs(corr) * 4294967295.0);
+	wl->cur = 0;
+	wl->phase_len = wl->phases > 1 ? phase_len : 0;
+	wl->phase_left = wl->phase_len;
+	wl->next = WL_BATCH;
+	return 0;
+}
+
+void workload_fill(struct workload *wl, unsigned int *sizes, unsigned int *durs, int n){
+	int i, s, d;
+	struct wl_phase *ph = &wl->phase[wl->cur];
+
+	for (i = 0; i < n; i++){
+		if (wl->phase_len > 0 && wl->phase_left-- == 0){
+			wl->cur = (wl->cur + 1) % wl->phases;
+			wl->phase_left = wl->phase_len - 1;
+			ph = &wl->phase[wl->cur];
+		}
+		s = alias_sample(&ph->size, wl_rand(wl));
+		if (ph->dur_for_size != NULL && (unsigned int) wl_rand(wl) < wl->corr_cut){
+			d = ph->dur_for_size[s];
+		}
+		else {
+			d = alias_sample(&ph->dur, wl_rand(wl));
+		}
+		sizes[i] = ph->size.min + s;
+		durs[i] = ph->dur.min + d;
+	}
+}
+
+void workload_next(struct workload *wl, unsigned int *size, unsigned int *duration){
+	if (wl->next >= WL_BATCH){
+		workload_fill(wl, wl->sizes, wl->durs, WL_BATCH);
+		wl->next = 0;
+	}
+	*size = wl->sizes[wl->next];
+	*duration = wl->durs[wl->next];
+	wl->next++;
+}
+
+void workload_free(struct workload *wl){
+	int i;
+	for (i = 0; i < WL_MAX_PHASES; i++){
+		alias_free(&wl->phase[i].size);
+		alias_free(&wl->phase[i].dur);
+		free(wl->phase[i].dur_for_size);
+		wl->phase[i].dur_for_size = NULL;
+	}
+}
@@ -0,0 +1,86 @@
+/*
+  Workload generator for the memory simulator.
+
+  Request sizes and durations are drawn from discrete distributions
+  over an integer range [min, max].  Each distribution is turned into
+  an alias table (Walker's method) once, so every sample afterwards
+  costs one PRNG draw and one table lookup no matter how skewed the
+  distribution is.
+*/
+
+/* number of requests generated per refill of the batch buffer */
+#define WL_BATCH 1024
+
+/* most phases one workload may cycle through, and their default length */
+#define WL_MAX_PHASES 8
+#define WL_PHASE_LEN 1000
+
+typedef unsigned long long wl_u64;
+
+/*
+  Alias table over the values min..max.  prob[i] is the chance (scaled
+  to 32 bits) of keeping column i, otherwise alias[i] is returned.
+*/
+struct wl_alias {
+	int min;
+	int n;
+	unsigned int *prob;
+	int *alias;
+	double *cdf;   /* cumulative mid-point of each value, for correlation */
+};
+
+/* one stationary stretch of the trace */
+struct wl_phase {
+	struct wl_alias size;
+	struct wl_alias dur;
+	int *dur_for_size;           /* duration at the same quantile as size */
+};
+
+struct workload {
+	wl_u64 rng;                  /* xorshift64* state, never zero */
+	struct wl_phase phase[WL_MAX_PHASES];
+	int phases;
+	int cur;                     /* phase now being generated */
+	long phase_len;              /* requests per phase */
+	long phase_left;             /* requests left in the current phase */
+	double corr;                 /* size/duration correlation in [-1, 1] */
+	unsigned int corr_cut;       /* |corr| scaled to 32 bits */
+	unsigned int sizes[WL_BATCH];
+	unsigned int durs[WL_BATCH];
+	int next;                    /* next unread slot in the batch */
+};
+
+/*
+  Build a workload.  size_spec and dur_spec name a distribution:
+
+    uniform
+    lognormal[:mu:sigma]
+    pareto[:alpha]
+    bimodal[:mean1:mean2:spread:weight1]
+    file:<path>        (empirical histogram, "value weight" per line)
+
+  Any parametric spec may end in "@min-max" to override the default
+  range (MIN/MAX_REQUEST_SIZE or MIN/MAX_DURATION from mem.h).  A
+  NULL spec means uniform.  corr couples the two: at 1 a request's
+  duration has the same quantile as its size, at -1 the opposite
+  quantile, at 0 they are independent.
+
+  Either spec may be a comma separated list to make a trace that changes
+  character: phase i uses the i-th size and i-th duration spec (a shorter
+  list repeats its last entry), and the workload moves on to the next
+  phase, cycling, every phase_len requests.
+
+    uniform@3-10,pareto:1.2@3-1000
+
+  Returns 0 on success, -1 on a bad spec (an error is printed).
+ */
+int workload_init(struct workload *wl, const char *size_spec, const char *dur_spec,
+                  double corr, long phase_len, unsigned int seed);
+
+/* Fill sizes[] and durs[] with n requests. */
+void workload_fill(struct workload *wl, unsigned int *sizes, unsigned int *durs, int n);
+
+/* Return the next request from the internal batch, refilling as needed. */
+void workload_next(struct workload *wl, unsigned int *size, unsigned int *duration);
+
+void workload_free(struct workload *wl);
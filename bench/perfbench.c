@@ -0,0 +1,444 @@
+#include <stdio.h>         // for printf()
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>          // for sqrt(), lgamma()
+#include <time.h>
+#include <unistd.h>        // for fork(), getopt()
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>  // for wait4() and peak RSS
+
+/*
+
+  ---------------------------------------------------------------------
+  Performance regression harness
+  ---------------------------------------------------------------------
+
+    ./perfbench [-w warmup] [-r reps] [-a alpha] [-e effect]
+                [-o results.json] [-b baseline.json] matrix
+
+  Runs every case of the matrix file warmup times untimed, then reps
+  times timed, recording the wall time, the work done per second and
+  the peak RSS of each run.  The results go to results.json.
+
+  With a baseline, each case's work per second is compared with the
+  baseline's using Welch's t-test.  A case is SLOWER when the drop is
+  significant at alpha (default 0.05) and larger than effect (default
+  0.02, i.e. 2%); the exit status is 1 if any case is SLOWER.
+
+  Matrix lines (blank lines and lines starting with '#' are skipped):
+
+    <name> <directory> <work> <command ...>
+
+  The command runs in <directory> under /bin/sh.  <work> is the number
+  of units (samples, meals, allocations) one run performs, or @key to
+  read it from the command's output: the first number after "key".
+
+*/
+
+#define MAX_CASES 256
+#define MAX_REPS  100
+#define NAME_LEN  64
+#define CMD_LEN   512
+
+struct bench_case {
+  char name[NAME_LEN];
+  char dir[CMD_LEN];
+  char work[NAME_LEN];
+  char cmd[CMD_LEN];
+  int reps;
+  double wall[MAX_REPS];      // seconds
+  double rate[MAX_REPS];      // work per second
+  long rss_kb;                // largest peak RSS over the runs
+};
+
+static struct bench_case cases[MAX_CASES], base[MAX_CASES];
+static int ncases, nbase;
+
+// ---------------------------------------------------------------------
+// statistics
+// ---------------------------------------------------------------------
+
+static double mean(const double *x, int n)
+{
+  double s = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    s += x[i];
+  return n > 0 ? s / n : 0;
+
+} // end mean function
+
+static double variance(const double *x, int n)
+{
+  double m = mean(x, n), s = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    s += (x[i] - m) * (x[i] - m);
+  return n > 1 ? s / (n - 1) : 0;
+
+} // end variance function
+
+// continued fraction for the incomplete beta function (modified Lentz)
+static double betacf(double a, double b, double x)
+{
+  double c = 1, d = 1 - (a + b) * x / (a + 1), h, aa, del;
+  int m;
+
+  if (fabs(d) < 1e-300) d = 1e-300;
+  d = 1 / d;
+  h = d;
+  for (m = 1; m <= 300; m++) {
+    aa = m * (b - m) * x / ((a + 2*m - 1) * (a + 2*m));
+    d = 1 + aa * d;  if (fabs(d) < 1e-300) d = 1e-300;
+    c = 1 + aa / c;  if (fabs(c) < 1e-300) c = 1e-300;
+    d = 1 / d;
+    h *= d * c;
+    aa = -(a + m) * (a + b + m) * x / ((a + 2*m) * (a + 2*m + 1));
+    d = 1 + aa * d;  if (fabs(d) < 1e-300) d = 1e-300;
+    c = 1 + aa / c;  if (fabs(c) < 1e-300) c = 1e-300;
+    d = 1 / d;
+    del = d * c;
+    h *= del;
+    if (fabs(del - 1) < 1e-12)
+      break;
+  }
+  return h;
+
+} // end betacf function
+
+// regularized incomplete beta function I_x(a, b)
+static double ibeta(double a, double b, double x)
+{
+  double front;
+
+  if (x <= 0) return 0;
+  if (x >= 1) return 1;
+  front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+  if (x < (a + 1) / (a + b + 2))
+    return front * betacf(a, b, x) / a;
+  return 1 - front * betacf(b, a, 1 - x) / b;
+
+} // end ibeta function
+
+// two sided p-value of Welch's t-test for equal means
+static double welch_p(const double *x, int nx, const double *y, int ny)
+{
+  double vx = variance(x, nx) / nx, vy = variance(y, ny) / ny, t, df;
+
+  if (nx < 2 || ny < 2)
+    return 1;
+  if (vx + vy == 0)
+    return mean(x, nx) == mean(y, ny) ? 1 : 0;
+
+  t = (mean(x, nx) - mean(y, ny)) / sqrt(vx + vy);
+  df = (vx + vy) * (vx + vy) / (vx * vx / (nx - 1) + vy * vy / (ny - 1));
+  return ibeta(df / 2, 0.5, df / (df + t * t));
+
+} // end welch_p function
+
+// ---------------------------------------------------------------------
+// running
+// ---------------------------------------------------------------------
+
+// the first number after key in out, or -1
+static double find_work(const char *out, const char *key)
+{
+  const char *p = strstr(out, key);
+
+  if (p == NULL)
+    return -1;
+  for (p += strlen(key); *p && (*p < '0' || *p > '9'); p++)
+    ;
+  return *p ? strtod(p, NULL) : -1;
+
+} // end find_work function
+
+// run one case once; returns 0 and fills in the timing, or -1
+static int run_once(struct bench_case *c, double *wall, double *rate, long *rss_kb)
+{
+  struct timespec t0, t1;
+  struct rusage ru;
+  char *out = NULL;
+  size_t len = 0, cap = 0;
+  ssize_t n;
+  int fds[2], status, devnull;
+  double work;
+  pid_t pid;
+
+  if (pipe(fds) != 0)
+    return -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if ((pid = fork()) == 0) {
+    devnull = open("/dev/null", O_WRONLY);
+    dup2(fds[1], 1);
+    dup2(devnull, 2);
+    close(fds[0]);
+    if (chdir(c->dir) != 0)
+      _exit(127);
+    execl("/bin/sh", "sh", "-c", c->cmd, (char*) NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return -1;
+  }
+
+  // keep all of stdout, the work count may be anywhere in it
+  do {
+    if (len + 4096 + 1 > cap) {
+      cap = cap ? cap * 2 : 65536;
+      out = realloc(out, cap);
+    }
+    n = read(fds[0], out + len, cap - len - 1);
+    if (n > 0)
+      len += n;
+  } while (n > 0);
+  out[len] = '\0';
+  close(fds[0]);
+
+  wait4(pid, &status, 0, &ru);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  *wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  *rss_kb = ru.ru_maxrss;
+  work = c->work[0] == '@' ? find_work(out, c->work + 1) : atof(c->work);
+  free(out);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || work < 0) {
+    fprintf(stderr, "%s: command failed or printed no \"%s\"\n", c->name, c->work + 1);
+    return -1;
+  }
+  *rate = work / *wall;
+  return 0;
+
+} // end run_once function
+
+static int load_matrix(const char *path)
+{
+  char line[CMD_LEN * 2];
+  struct bench_case *c;
+  FILE *fp;
+  int at;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL && ncases < MAX_CASES) {
+    line[strcspn(line, "\n")] = '\0';
+    c = &cases[ncases];
+    if (line[0] == '#' || sscanf(line, "%63s %511s %63s %n", c->name, c->dir, c->work, &at) != 3)
+      continue;
+    strncpy(c->cmd, line + at, CMD_LEN - 1);
+    if (c->cmd[0] != '\0')
+      ncases++;
+  }
+  fclose(fp);
+  return 0;
+
+} // end load_matrix function
+
+// ---------------------------------------------------------------------
+// results
+// ---------------------------------------------------------------------
+
+static void json_string(FILE *fp, const char *s)
+{
+  fputc('"', fp);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', fp);
+    fputc(*s, fp);
+  }
+  fputc('"', fp);
+
+} // end json_string function
+
+static void json_array(FILE *fp, const double *x, int n)
+{
+  int i;
+
+  fputc('[', fp);
+  for (i = 0; i < n; i++)
+    fprintf(fp, "%s%.9g", i ? ", " : "", x[i]);
+  fputc(']', fp);
+
+} // end json_array function
+
+// one case per line, so load_results can read the file back simply
+static int save_results(const char *path, int warmup)
+{
+  FILE *fp;
+  int i;
+
+  if ((fp = fopen(path, "w")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  fprintf(fp, "{\"warmup\": %d, \"cases\": [\n", warmup);
+  for (i = 0; i < ncases; i++) {
+    fprintf(fp, "  {\"name\": ");
+    json_string(fp, cases[i].name);
+    fprintf(fp, ", \"command\": ");
+    json_string(fp, cases[i].cmd);
+    fprintf(fp, ", \"reps\": %d, \"wall_s\": ", cases[i].reps);
+    json_array(fp, cases[i].wall, cases[i].reps);
+    fprintf(fp, ", \"work_per_s\": ");
+    json_array(fp, cases[i].rate, cases[i].reps);
+    fprintf(fp, ", \"mean_wall_s\": %.6f, \"mean_work_per_s\": %.1f, \"peak_rss_kb\": %ld}%s\n",
+            mean(cases[i].wall, cases[i].reps), mean(cases[i].rate, cases[i].reps),
+            cases[i].rss_kb, i + 1 < ncases ? "," : "");
+  }
+  fprintf(fp, "]}\n");
+  fclose(fp);
+  return 0;
+
+} // end save_results function
+
+// read back the numbers after "key": [ ... ]
+static int read_array(const char *line, const char *key, double *x)
+{
+  const char *p = strstr(line, key);
+  char *end;
+  int n = 0;
+
+  if (p == NULL || (p = strchr(p, '[')) == NULL)
+    return 0;
+  for (p++; n < MAX_REPS; p = end) {
+    while (*p == ' ' || *p == ',')
+      p++;
+    x[n] = strtod(p, &end);
+    if (end == p)
+      break;
+    n++;
+  }
+  return n;
+
+} // end read_array function
+
+static int load_results(const char *path)
+{
+  char line[CMD_LEN * 8];
+  const char *p;
+  FILE *fp;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL && nbase < MAX_CASES) {
+    if ((p = strstr(line, "\"name\": \"")) == NULL
+        || sscanf(p + 9, "%63[^\"]", base[nbase].name) != 1)
+      continue;
+    base[nbase].reps = read_array(line, "\"work_per_s\"", base[nbase].rate);
+    read_array(line, "\"wall_s\"", base[nbase].wall);
+    if ((p = strstr(line, "\"peak_rss_kb\": ")) != NULL)
+      base[nbase].rss_kb = atol(p + 15);
+    nbase++;
+  }
+  fclose(fp);
+  return 0;
+
+} // end load_results function
+
+// print a verdict per case; returns the number of regressions
+static int compare(double alpha, double effect)
+{
+  struct bench_case *b, *c;
+  double now, then, change, p;
+  const char *verdict;
+  int i, j, slower = 0;
+
+  printf("\n%-22s %14s %14s %8s %8s %8s  %s\n",
+         "case", "base work/s", "work/s", "change", "p", "rss", "verdict");
+  for (i = 0; i < ncases; i++) {
+    c = &cases[i];
+    for (b = NULL, j = 0; j < nbase; j++)
+      if (strcmp(base[j].name, c->name) == 0)
+        b = &base[j];
+    if (b == NULL || b->reps == 0) {
+      printf("%-22s %14s %14.0f %8s %8s %8s  %s\n", c->name, "-",
+             mean(c->rate, c->reps), "-", "-", "-", "new");
+      continue;
+    }
+
+    now = mean(c->rate, c->reps);
+    then = mean(b->rate, b->reps);
+    change = then > 0 ? (now - then) / then : 0;
+    p = welch_p(c->rate, c->reps, b->rate, b->reps);
+    if (p < alpha && change < -effect) {
+      verdict = "SLOWER";
+      slower++;
+    }
+    else if (p < alpha && change > effect)
+      verdict = "faster";
+    else
+      verdict = "same";
+
+    printf("%-22s %14.0f %14.0f %+7.1f%% %8.4f %+7.0f%%  %s\n", c->name, then, now,
+           100 * change, p, b->rss_kb > 0 ? 100.0 * (c->rss_kb - b->rss_kb) / b->rss_kb : 0.0,
+           verdict);
+  }
+  return slower;
+
+} // end compare function
+
+// ---------------------------------------------------------------------
+
+int main( int argc, char** argv ) {
+
+  const char *out = NULL, *baseline = NULL;
+  double alpha = 0.05, effect = 0.02, wall, rate;
+  int warmup = 1, reps = 5, opt, i, r, failed = 0, bad = 0;
+  long rss;
+
+  while ((opt = getopt(argc, argv, "w:r:a:e:o:b:")) != -1) {
+    switch (opt) {
+      case 'w': warmup = atoi(optarg); break;
+      case 'r': reps = atoi(optarg); break;
+      case 'a': alpha = atof(optarg); break;
+      case 'e': effect = atof(optarg); break;
+      case 'o': out = optarg; break;
+      case 'b': baseline = optarg; break;
+      default:  bad = 1; break;
+    }
+  }
+  if (bad || optind != argc - 1 || reps < 1 || reps > MAX_REPS || warmup < 0) {
+    fprintf(stderr, "usage: perfbench [-w warmup] [-r reps] [-a alpha] [-e effect]\n"
+                    "                 [-o results.json] [-b baseline.json] matrix\n");
+    exit(1);
+  }
+  if (load_matrix(argv[optind]) != 0 || (baseline && load_results(baseline) != 0))
+    exit(1);
+
+  printf("%-22s %12s %12s %14s %10s\n", "case", "mean s", "stddev s", "work/s", "rss kb");
+  for (i = 0; i < ncases; i++) {
+    for (r = 0; r < warmup; r++)
+      run_once(&cases[i], &wall, &rate, &rss);
+    for (r = 0; r < reps; r++) {
+      if (run_once(&cases[i], &cases[i].wall[r], &cases[i].rate[r], &rss) != 0) {
+        failed++;
+        break;
+      }
+      if (rss > cases[i].rss_kb)
+        cases[i].rss_kb = rss;
+    }
+    cases[i].reps = r;
+    printf("%-22s %12.4f %12.4f %14.0f %10ld\n", cases[i].name,
+           mean(cases[i].wall, r), sqrt(variance(cases[i].wall, r)),
+           mean(cases[i].rate, r), cases[i].rss_kb);
+    fflush(stdout);
+  }
+
+  if (out && save_results(out, warmup) != 0)
+    exit(1);
+  if (baseline && compare(alpha, effect) > 0)
+    exit(1);
+  return failed ? 1 : 0;
+
+} // end main function